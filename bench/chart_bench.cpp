@@ -0,0 +1,264 @@
+/* 解析、PEZ 解包与合并的基准测试
+ *
+ * 用法：
+ *   chart_bench                         按内置的参数组合依次测量
+ *   chart_bench [选项]                  只测量一组参数
+ *
+ * 选项：
+ *   --lines N --layers N --events N --notes N
+ *   --extended N --extended-events N --seed N
+ *   --cards N            合并时的卡片数（每张卡片取一个时间窗口）
+ *   --iterations N       每个场景重复次数，取最快一次
+ *   --scenario S         parse | pez | load | pezload | merge | all
+ *   --threads N          合并时的线程数，0 表示按硬件线程数（默认 1）
+ *
+ * 输出每个场景的耗时、MB/s、事件/s，以及该场景相对开始时多占用的峰值常驻内存
+ * （不含输入数据本身，Linux 下有效）。
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#ifdef __linux__
+#include <sys/resource.h>
+#endif
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "chart_gen.h"
+#include "chart_core.h"
+#include "chart_cache.h"
+#include "json_writer.h"
+
+namespace {
+
+struct BenchOptions {
+    ChartGenConfig chart;
+    int cards = 4;
+    int iterations = 3;
+    std::string scenario = "all";
+    int threads = 1;
+};
+
+// 读取 /proc/self/status 中的某一项（单位 kB）
+size_t proc_status_bytes(const char* field) {
+#ifdef __linux__
+    if (FILE* fp = fopen("/proc/self/status", "r")) {
+        char line[256];
+        size_t len = strlen(field);
+        size_t kb = 0;
+        while (fgets(line, sizeof(line), fp)) {
+            if (strncmp(line, field, len) == 0) {
+                kb = strtoull(line + len, nullptr, 10);
+                break;
+            }
+        }
+        fclose(fp);
+        return kb * 1024;
+    }
+#endif
+    (void)field;
+    return 0;
+}
+
+/* 清零峰值常驻内存统计并返回当前常驻内存
+ * 先把 malloc 缓存的空闲内存还给系统，否则上一个场景留下的空闲块会被算进基线。
+ */
+size_t reset_peak_rss() {
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+#ifdef __linux__
+    // Linux 4.0+ 支持向 clear_refs 写 5 重置 VmHWM
+    if (FILE* fp = fopen("/proc/self/clear_refs", "w")) {
+        fputs("5", fp);
+        fclose(fp);
+    }
+#endif
+    return proc_status_bytes("VmRSS:");
+}
+
+size_t peak_rss_bytes() {
+    size_t peak = proc_status_bytes("VmHWM:");
+#ifdef __linux__
+    if (peak == 0) {
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0) {
+            peak = static_cast<size_t>(usage.ru_maxrss) * 1024;
+        }
+    }
+#endif
+    return peak;
+}
+
+struct Measurement {
+    double best_seconds;
+    size_t peak_rss;  // 相对场景开始时的峰值增量
+};
+
+Measurement measure(int iterations, const std::function<void()>& body) {
+    Measurement m = {0.0, 0};
+    size_t baseline = reset_peak_rss();
+    for (int i = 0; i < iterations; ++i) {
+        auto begin = std::chrono::steady_clock::now();
+        body();
+        auto end = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(end - begin).count();
+        if (i == 0 || seconds < m.best_seconds) m.best_seconds = seconds;
+    }
+    size_t peak = peak_rss_bytes();
+    m.peak_rss = peak > baseline ? peak - baseline : 0;
+    return m;
+}
+
+void report(const char* scenario, const ChartGenConfig& c, size_t bytes, size_t items,
+            const Measurement& m) {
+    double mb = static_cast<double>(bytes) / (1024.0 * 1024.0);
+    double seconds = m.best_seconds > 0 ? m.best_seconds : 1e-9;
+    printf("%-6s lines=%-4d layers=%-2d events=%-5d notes=%-5d | %8.2f MB %9.2f ms %8.1f MB/s %11.0f ev/s | peak +%6.1f MB\n",
+           scenario, c.judge_lines, c.layers, c.events_per_type, c.notes,
+           mb, m.best_seconds * 1000.0, mb / seconds, static_cast<double>(items) / seconds,
+           static_cast<double>(m.peak_rss) / (1024.0 * 1024.0));
+    fflush(stdout);
+}
+
+void run_config(const BenchOptions& opt) {
+    GeneratedChart chart = generate_chart(opt.chart);
+    size_t items = chart.event_count + chart.special_event_count + chart.note_count;
+    bool all = opt.scenario == "all";
+
+    if (all || opt.scenario == "parse") {
+        Measurement m = measure(opt.iterations, [&]() {
+            ParseResult res = parse_single_json(chart.json.data(), chart.json.size());
+            if (res.error_code != 0) fprintf(stderr, "parse failed: %d\n", res.error_code);
+        });
+        report("parse", opt.chart, chart.json.size(), items, m);
+    }
+
+    if (all || opt.scenario == "pez") {
+        std::string pez = make_pez(chart.json, 4 * 1024 * 1024);
+        Measurement m = measure(opt.iterations, [&]() {
+            size_t len = 0;
+            int error_code = PEZ_OK;
+            char* data = extract_pez_chart(reinterpret_cast<const unsigned char*>(pez.data()),
+                                           pez.size(), &len, &error_code);
+            if (!data) fprintf(stderr, "extract failed: %d\n", error_code);
+            free(data);
+        });
+        report("pez", opt.chart, chart.json.size(), items, m);
+    }
+
+    if (all || opt.scenario == "load") {
+        // 载入卡片：统计并建立紧凑存储
+        Measurement m = measure(opt.iterations, [&]() {
+            ParseResult res;
+            std::shared_ptr<ParsedChart> parsed = parse_chart(chart.json.data(), chart.json.size(), res);
+            if (!parsed) fprintf(stderr, "load failed: %d\n", res.error_code);
+        });
+        report("load", opt.chart, chart.json.size(), items, m);
+    }
+
+    if (all || opt.scenario == "pezload") {
+        // 从 PEZ 边解压边载入
+        std::string pez = make_pez(chart.json, 4 * 1024 * 1024);
+        Measurement m = measure(opt.iterations, [&]() {
+            ParseResult res;
+            std::shared_ptr<ParsedChart> parsed = parse_pez_chart(
+                reinterpret_cast<const unsigned char*>(pez.data()), pez.size(), res);
+            if (!parsed) fprintf(stderr, "pez load failed: %d\n", res.error_code);
+        });
+        report("pezload", opt.chart, chart.json.size(), items, m);
+    }
+
+    if (all || opt.scenario == "merge") {
+        // 每张卡片取谱面中相邻的一段，模拟多人合作时拼接片段
+        std::vector<MergeWindow> windows;
+        int span = std::max(1, chart.total_beats / std::max(1, opt.cards));
+        for (int i = 0; i < opt.cards; ++i) {
+            windows.push_back({i * span, (i + 1) * span});
+        }
+        std::string form = make_merge_form(chart.json, windows, false, true);
+        Measurement m = measure(opt.iterations, [&]() {
+            // 与 finalize_merge 相同的流程：解析表单、合并、序列化
+            json form_json = json::parse(form, nullptr, false);
+            OutputBuffer out;
+            merge_to_buffer(std::move(form_json), nullptr, 3, out, static_cast<unsigned>(opt.threads));
+            if (out.size() == 0) fprintf(stderr, "merge produced no output\n");
+        });
+        report("merge", opt.chart, form.size(), items * windows.size(), m);
+    }
+}
+
+bool parse_int_arg(int argc, char** argv, int& i, int& out) {
+    if (i + 1 >= argc) return false;
+    out = atoi(argv[++i]);
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    BenchOptions opt;
+    bool custom = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool ok = true;
+        if (arg == "--lines") { ok = parse_int_arg(argc, argv, i, opt.chart.judge_lines); custom = true; }
+        else if (arg == "--layers") { ok = parse_int_arg(argc, argv, i, opt.chart.layers); custom = true; }
+        else if (arg == "--events") { ok = parse_int_arg(argc, argv, i, opt.chart.events_per_type); custom = true; }
+        else if (arg == "--notes") { ok = parse_int_arg(argc, argv, i, opt.chart.notes); custom = true; }
+        else if (arg == "--extended") { ok = parse_int_arg(argc, argv, i, opt.chart.extended_arrays); custom = true; }
+        else if (arg == "--extended-events") { ok = parse_int_arg(argc, argv, i, opt.chart.extended_events); custom = true; }
+        else if (arg == "--seed" && i + 1 < argc) { opt.chart.seed = strtoull(argv[++i], nullptr, 10); }
+        else if (arg == "--cards") { ok = parse_int_arg(argc, argv, i, opt.cards); }
+        else if (arg == "--iterations") { ok = parse_int_arg(argc, argv, i, opt.iterations); }
+        else if (arg == "--scenario" && i + 1 < argc) { opt.scenario = argv[++i]; }
+        else if (arg == "--threads") { ok = parse_int_arg(argc, argv, i, opt.threads); }
+        else { ok = false; }
+
+        if (!ok) {
+            fprintf(stderr, "未知或不完整的参数: %s\n", arg.c_str());
+            return 1;
+        }
+    }
+    if (opt.iterations < 1) opt.iterations = 1;
+    if (opt.threads < 0) opt.threads = 1;
+
+    if (custom) {
+        run_config(opt);
+        return 0;
+    }
+
+    // 分别考察判定线数量、事件密度与音符数量的影响
+    const ChartGenConfig base = opt.chart;
+    std::vector<ChartGenConfig> sweep;
+    for (int lines : {10, 50, 100}) {
+        ChartGenConfig c = base;
+        c.judge_lines = lines;
+        sweep.push_back(c);
+    }
+    for (int events : {25, 250, 500}) {
+        ChartGenConfig c = base;
+        c.events_per_type = events;
+        sweep.push_back(c);
+    }
+    for (int notes : {1000, 5000}) {
+        ChartGenConfig c = base;
+        c.notes = notes;
+        sweep.push_back(c);
+    }
+
+    for (const auto& c : sweep) {
+        BenchOptions run = opt;
+        run.chart = c;
+        run_config(run);
+    }
+    return 0;
+}
@@ -0,0 +1,291 @@
+/* 两种 JSON 解析器的一致性检查
+ *
+ * 用法：
+ *   chart_equivalence [--seed N]
+ *
+ * 同一份输入分别只用就地解析（Insitu）和 nlohmann（Nlohmann）解析，二者必须同时成功或同时失败，
+ * 成功时统计信息（ParseResult）与写回的紧凑 JSON（write_chart）逐字节相同。
+ * 输入包括基准测试的合成谱面、手写的边界情况（转义、代理对、非法 UTF-8、指数与次正规数、截断）
+ * 以及对合成谱面的随机截断与改写。
+ * 写回的 JSON 再逐个值经 JsonWriter 写出，须与 json::dump 的结果逐字节相同（JsonWriter 借用了 nlohmann 的内部实现）。
+ * 同样的输入再以不同的分块大小送入流式解析（JsonPushParser），结果须与整块解析相同；
+ * 快照（read_chart_snapshot）须能原样恢复，截断的快照一律拒绝，改写过的快照不能导致崩溃。
+ *
+ * 全部一致时返回 0，否则输出前几处差异并返回 1。
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "chart_gen.h"
+#include "chart_core.h"
+#include "chart_cache.h"
+#include "chart_snapshot.h"
+#include "json_insitu_parser.h"
+#include "json_writer.h"
+
+namespace {
+
+struct Outcome {
+    bool ok;
+    std::string stats;   // result_to_object 的紧凑 JSON
+    std::string chart;   // write_chart 的输出
+};
+
+struct Checker {
+    size_t cases = 0;
+    size_t accepted = 0;
+    size_t mismatches = 0;
+
+    void fail(const char* what, const std::string& input, const Outcome& a, const Outcome& b) {
+        if (mismatches++ >= 10) return;
+        printf("MISMATCH %s ok=%d/%d input=[%.120s]\n  %.200s\n  %.200s\n", what, a.ok, b.ok,
+               input.c_str(), a.stats.c_str(), b.stats.c_str());
+    }
+};
+
+std::string dump_chart(const ParsedChart& chart) {
+    OutputBuffer out;
+    JsonWriter writer(out, -1);
+    write_chart(chart, writer);
+    return std::string(out.data(), out.size());
+}
+
+void write_value(JsonWriter& writer, const json& value) {
+    if (value.is_object()) {
+        writer.begin_object();
+        for (const auto& [key, item] : value.items()) {
+            writer.key(key);
+            write_value(writer, item);
+        }
+        writer.end_object();
+    } else if (value.is_array()) {
+        writer.begin_array();
+        for (const json& item : value) write_value(writer, item);
+        writer.end_array();
+    } else if (value.is_number_integer() && (value.is_number_unsigned() ? value.get<uint64_t>() <= INT64_MAX : true)) {
+        writer.value(value.get<int64_t>());
+    } else if (value.is_number_float()) {
+        writer.value(value.get<double>());
+    } else {
+        writer.value(value);
+    }
+}
+
+// JsonWriter 自己写出的容器、键与数字，不整棵交给 nlohmann
+std::string write_dom(const json& dom, int indent) {
+    OutputBuffer out;
+    JsonWriter writer(out, indent);
+    write_value(writer, dom);
+    return std::string(out.data(), out.size());
+}
+
+Outcome outcome_of(const std::shared_ptr<ParsedChart>& chart, const ParseResult& stats) {
+    return {chart != nullptr,
+            result_to_object(stats).dump(-1, ' ', false, json::error_handler_t::replace),
+            chart ? dump_chart(*chart) : std::string()};
+}
+
+bool same(const Outcome& a, const Outcome& b) {
+    return a.ok == b.ok && a.stats == b.stats && a.chart == b.chart;
+}
+
+Outcome parse_with(JsonBackend backend, const std::string& input) {
+    ParseResult stats;
+    auto chart = parse_chart_with(backend, input.data(), input.size(), stats);
+    return outcome_of(chart, stats);
+}
+
+Outcome parse_stream(const std::string& input, size_t chunk) {
+    ParseResult stats;
+    ChartStreamParser parser(stats);
+    for (size_t offset = 0; offset < input.size(); offset += chunk) {
+        if (!parser.feed(input.data() + offset, std::min(chunk, input.size() - offset))) break;
+    }
+    auto chart = parser.finish();
+    return outcome_of(chart, stats);
+}
+
+// 两种解析器与流式解析（小块、整块，byte_chunks 时再加上逐字节与 4KB 分块）的结果须完全相同
+void check_input(Checker& checker, const std::string& input, bool byte_chunks) {
+    checker.cases++;
+    Outcome insitu = parse_with(JsonBackend::Insitu, input);
+    Outcome nlohmann = parse_with(JsonBackend::Nlohmann, input);
+    if (nlohmann.ok) checker.accepted++;
+    if (!same(insitu, nlohmann)) checker.fail("insitu/nlohmann", input, insitu, nlohmann);
+    // 写回的谱面再逐个值经 JsonWriter 写出（紧凑与缩进两种格式），须与 json::dump 逐字节相同
+    if (nlohmann.ok) {
+        json dom = json::parse(nlohmann.chart, nullptr, false);
+        for (int indent : {-1, 3}) {
+            Outcome dumped = {!dom.is_discarded(), nlohmann.stats,
+                              dom.dump(indent, ' ', false, json::error_handler_t::replace)};
+            Outcome written = {true, nlohmann.stats, write_dom(dom, indent)};
+            if (!same(written, dumped)) checker.fail("JsonWriter/dump", input, written, dumped);
+        }
+    }
+
+    std::vector<size_t> chunks = {7, input.size() + 1};
+    if (byte_chunks) chunks.insert(chunks.end(), {1, 4096});
+    for (size_t chunk : chunks) {
+        Outcome stream = parse_stream(input, chunk);
+        if (!same(stream, nlohmann)) checker.fail("stream/nlohmann", input, stream, nlohmann);
+    }
+}
+
+// 快照须原样恢复；任何截断都被拒绝；改写过的快照可以被接受，但恢复出的谱面必须能正常写回
+void check_snapshot(Checker& checker, const std::string& input, std::mt19937_64& rng) {
+    ParseResult stats;
+    auto chart = parse_chart(input.data(), input.size(), stats);
+    if (!chart) return;
+    OutputBuffer out;
+    if (!write_chart_snapshot(*chart, stats, true, 42, out)) {
+        printf("快照写出失败\n");
+        checker.mismatches++;
+        return;
+    }
+    const Outcome expected = outcome_of(chart, stats);
+    const auto* data = reinterpret_cast<const unsigned char*>(out.data());
+    std::vector<unsigned char> snapshot(data, data + out.size());
+
+    auto restore = [&](const std::vector<unsigned char>& bytes, size_t size) {
+        ParseResult restored_stats;
+        bool has_hash = false;
+        uint64_t hash = 0;
+        auto restored = read_chart_snapshot(bytes.data(), size, restored_stats, has_hash, hash);
+        return outcome_of(restored, restored_stats);
+    };
+
+    checker.cases++;
+    Outcome full = restore(snapshot, snapshot.size());
+    if (!same(full, expected)) checker.fail("snapshot", input, full, expected);
+
+    for (size_t size = 0; size < snapshot.size(); ++size) {
+        checker.cases++;
+        Outcome truncated = restore(snapshot, size);
+        if (truncated.ok) checker.fail("snapshot truncated", std::to_string(size), truncated, expected);
+    }
+    for (int i = 0; i < 1000; ++i) {
+        std::vector<unsigned char> corrupted = snapshot;
+        int edits = 1 + static_cast<int>(rng() % 4);
+        for (int k = 0; k < edits; ++k) corrupted[rng() % corrupted.size()] = static_cast<unsigned char>(rng());
+        checker.cases++;
+        restore(corrupted, corrupted.size());
+    }
+}
+
+// 把 value 放进一份最小的谱面中：既作为曲名与判定线名（字符串），也作为 BPM 与事件值（数字）
+std::string small_chart(const std::string& name, const std::string& number) {
+    return "{\"BPMList\":[{\"bpm\":" + number + ",\"startTime\":[0,0,1]}],"
+           "\"META\":{\"RPEVersion\":150,\"name\":" + name + ",\"charter\":\"c\",\"composer\":\"x\","
+           "\"id\":\"1\",\"level\":\"IN\"},"
+           "\"judgeLineList\":[{\"Name\":" + name + ",\"eventLayers\":[{\"moveXEvents\":"
+           "[{\"start\":" + number + ",\"end\":-" + number + ",\"startTime\":[0,0,1],\"endTime\":[1,0,1]}]}],"
+           "\"notes\":[{\"type\":1,\"positionX\":" + number + ",\"startTime\":[0,0,1],\"endTime\":[0,0,1]}]}]}";
+}
+
+const char* const EDGE_STRINGS[] = {
+    "\"abc\"", "\"\"", "\"a\\\"b\\\\c\\/d\"", "\"\\b\\f\\n\\r\\t\"", "\"\\u0000\"", "\"\\u0041\\u00e9\\u4e2d\"",
+    "\"\\ud83d\\ude00\"", "\"\\ud83d\"", "\"\\ude00\"", "\"\\ud83dx\"", "\"\\ud83d\\u0041\"", "\"\\u12\"", "\"\\u12g4\"",
+    "\"\\x\"", "\"\t\"", "\"\x7f\"", "\"\xc3\xa9\"", "\"\xc3\"", "\"\xc0\xaf\"", "\"\xe0\x80\x80\"", "\"\xed\xa0\x80\"",
+    "\"\xef\xbf\xbf\"", "\"\xf0\x9f\x98\x80\"", "\"\xf4\x90\x80\x80\"", "\"\xf8\x88\x80\x80\x80\"", "\"\xff\"",
+    "\"unterminated", "\"\\", "123", "null",
+};
+
+const char* const EDGE_NUMBERS[] = {
+    "0", "-0", "1", "01", "1.", ".5", "-", "1e", "1e+", "1E-2", "-0.0", "0e99999999", "0.0e-99999999",
+    "1e400", "1e-400", "1e308", "1.7976931348623157e308", "1.7976931348623158e308", "2.2250738585072014e-308",
+    "2.2250738585072011e-308", "4.9e-324", "2.4e-324", "5e-324", "1e22", "1e23", "9007199254740992",
+    "9007199254740993", "9007199254740993.0", "0.1", "0.30000000000000004", "123.456e-5", "1234567890123456789.5",
+    "12345678901234567890e-5", "18446744073709551615", "18446744073709551616", "-9223372036854775808",
+    "-9223372036854775809", "9223372036854775808", "123456789012345678901234567890", "1e-22", "3e-23",
+    "\"120\"", "true", "null", "[]",
+};
+
+const char* const EDGE_DOCUMENTS[] = {
+    "", " ", "{}", "[]", "null", "0", "\xEF\xBB\xBF{}", "\xEF\xBB{}", "{\"a\":1,}", "{\"a\" 1}", "[1,]", "{,}",
+    "{} x", "{}  ", "{\"META\":{\"name\":\"a\"}", "{\"judgeLineList\":[{}]}", "{\"judgeLineList\":{}}",
+    "{\"BPMList\":[{\"bpm\":120}],\"BPMList\":[]}", "{\"k\\u0041y\":\"v\"}",
+};
+
+std::string mutate(const std::string& input, std::mt19937_64& rng) {
+    static const char alphabet[] = "{}[],:\"\\-0e.9 \xc3\xe9u";
+    std::string out = input;
+    int edits = 1 + static_cast<int>(rng() % 3);
+    for (int k = 0; k < edits && !out.empty(); ++k) {
+        size_t pos = rng() % out.size();
+        switch (rng() % 3) {
+        case 0: out[pos] = static_cast<char>(rng()); break;
+        case 1: out.erase(pos, 1); break;
+        default: out.insert(pos, 1, alphabet[rng() % (sizeof(alphabet) - 1)]); break;
+        }
+    }
+    return out;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    uint64_t seed = 1;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--seed" && i + 1 < argc) {
+            seed = strtoull(argv[++i], nullptr, 10);
+        } else {
+            fprintf(stderr, "未知或不完整的参数: %s\n", arg.c_str());
+            return 1;
+        }
+    }
+    std::mt19937_64 rng(seed);
+    Checker checker;
+
+    // 合成谱面：默认规模一份，小规模的几份还要逐个前缀截断、随机改写
+    ChartGenConfig config;
+    config.judge_lines = 4;
+    config.seed = seed;
+    check_input(checker, generate_chart(config).json, false);
+
+    for (uint64_t i = 0; i < 4; ++i) {
+        ChartGenConfig small = {2, 1, 3, 4, 1, 2, seed + i};
+        std::string chart = generate_chart(small).json;
+        check_input(checker, chart, true);
+        for (size_t size = 0; size < chart.size(); size += 4 + 3 * i) {
+            check_input(checker, chart.substr(0, size), false);
+        }
+        for (int k = 0; k < 500; ++k) check_input(checker, mutate(chart, rng), false);
+        if (i == 0) check_snapshot(checker, chart, rng);
+    }
+
+    for (const char* name : EDGE_STRINGS) {
+        for (const char* number : EDGE_NUMBERS) {
+            std::string chart = small_chart(name, number);
+            check_input(checker, chart, true);
+            check_input(checker, chart.substr(0, chart.size() / 2), false);
+        }
+    }
+    for (const char* document : EDGE_DOCUMENTS) check_input(checker, document, true);
+    static const char embedded_nul[] = "{\"META\":{\"name\":\"a\0b\"}}";
+    check_input(checker, std::string(embedded_nul, sizeof(embedded_nul) - 1), true);
+    check_snapshot(checker, small_chart("\"\\ud83d\\ude00\xc3\xa9\"", "4.9e-324"), rng);
+
+    // 随机数值：各种格式的 double 与 64 位整数
+    const char* formats[] = {"%.17g", "%.15g", "%.6f", "%.3e", "%.0f", "%g"};
+    for (int i = 0; i < 3000; ++i) {
+        uint64_t bits = rng();
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        if (!std::isfinite(value)) continue;
+        char number[64];
+        snprintf(number, sizeof(number), formats[i % 6], value);
+        check_input(checker, small_chart("\"n\"", number), false);
+        check_input(checker, small_chart("\"n\"", std::to_string(static_cast<long long>(rng()))), false);
+    }
+
+    printf("cases=%zu accepted=%zu mismatches=%zu\n", checker.cases, checker.accepted, checker.mismatches);
+    return checker.mismatches == 0 ? 0 : 1;
+}
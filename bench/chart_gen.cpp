@@ -0,0 +1,219 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdarg>
+#include <algorithm>
+
+#include "chart_gen.h"
+#include "chart_core.h"
+#include "../include/miniz/miniz.h"
+
+namespace {
+
+// splitmix64：与平台和标准库实现无关，保证生成结果可复现
+class Rng {
+public:
+    explicit Rng(uint64_t seed) : state_(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (state_ += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    int range(int lo, int hi) {  // [lo, hi]
+        return lo + static_cast<int>(next() % static_cast<uint64_t>(hi - lo + 1));
+    }
+
+    double uniform(double lo, double hi) {
+        return lo + (hi - lo) * (static_cast<double>(next() >> 11) * (1.0 / 9007199254740992.0));
+    }
+
+private:
+    uint64_t state_;
+};
+
+void append_fmt(std::string& out, const char* fmt, ...) {
+    char buf[256];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (n > 0) out.append(buf, static_cast<size_t>(n) < sizeof(buf) ? n : sizeof(buf) - 1);
+}
+
+// 把第 index 个时间片转换成 [小节, 分子, 分母]
+void append_time(std::string& out, int index, int denominator) {
+    append_fmt(out, "[%d,%d,%d]", index / denominator, index % denominator, denominator);
+}
+
+/* 生成一组互不重叠的事件
+ * 事件按开始时间升序排列，均匀分布在 [0, total_beats) 小节内。
+ */
+void append_event_array(std::string& out, Rng& rng, int count, int total_beats,
+                        bool speed, size_t& counter) {
+    static const int denominators[] = {1, 2, 3, 4, 8, 16};
+    int denominator = denominators[rng.range(0, 5)];
+    int slots = total_beats * denominator;
+    int step = count > 0 ? std::max(1, slots / count) : 1;
+
+    out += '[';
+    int slot = 0;
+    for (int i = 0; i < count; ++i) {
+        if (i > 0) out += ',';
+        int length = std::max(1, rng.range(step / 2, step));
+        out += "{\"startTime\":";
+        append_time(out, slot, denominator);
+        out += ",\"endTime\":";
+        append_time(out, slot + length, denominator);
+        if (rng.range(0, 3) == 0) {
+            append_fmt(out, ",\"start\":%d,\"end\":%d", rng.range(-500, 500), rng.range(-500, 500));
+        } else {
+            append_fmt(out, ",\"start\":%.17g,\"end\":%.17g",
+                       rng.uniform(-675.0, 675.0), rng.uniform(-675.0, 675.0));
+        }
+        append_fmt(out, ",\"linkgroup\":0");
+        if (!speed) {
+            append_fmt(out, ",\"easingType\":%d,\"easingLeft\":0.0,\"easingRight\":1.0"
+                            ",\"bezier\":0,\"bezierPoints\":[0.0,0.0,0.0,0.0]",
+                       rng.range(1, 28));
+        }
+        out += '}';
+        slot += step;
+        counter++;
+    }
+    out += ']';
+}
+
+void append_notes(std::string& out, Rng& rng, int count, int total_beats, size_t& counter) {
+    int denominator = 4;
+    int slots = total_beats * denominator;
+    int step = count > 0 ? std::max(1, slots / count) : 1;
+
+    out += '[';
+    int slot = 0;
+    for (int i = 0; i < count; ++i) {
+        if (i > 0) out += ',';
+        int type = rng.range(1, 4);
+        int hold = type == 2 ? rng.range(1, 8) : 0;
+        append_fmt(out, "{\"above\":%d,\"alpha\":255,\"endTime\":", rng.range(1, 2));
+        append_time(out, slot + hold, denominator);
+        append_fmt(out, ",\"isFake\":0,\"positionX\":%.17g,\"size\":1.0,\"speed\":1.0,\"startTime\":",
+                   rng.uniform(-675.0, 675.0));
+        append_time(out, slot, denominator);
+        append_fmt(out, ",\"type\":%d,\"visibleTime\":999999.0,\"yOffset\":0.0}", type);
+        slot += step;
+        counter++;
+    }
+    out += ']';
+}
+
+}  // namespace
+
+GeneratedChart generate_chart(const ChartGenConfig& config) {
+    static const char* event_types[] = {
+        "alphaEvents", "moveXEvents", "moveYEvents", "rotateEvents", "speedEvents"
+    };
+
+    Rng rng(config.seed);
+    GeneratedChart chart = {"", 0, 0, 0, 0};
+    // 谱面长度随事件密度增长，保证时间窗口选择有意义
+    chart.total_beats = std::max(16, std::max(config.events_per_type, config.notes / 4));
+
+    std::string& out = chart.json;
+    out.reserve(static_cast<size_t>(config.judge_lines) *
+                (static_cast<size_t>(config.layers) * 5 * config.events_per_type * 190 +
+                 static_cast<size_t>(config.notes) * 190 + 512) + 1024);
+
+    append_fmt(out, "{\"BPMList\":[{\"bpm\":%.17g,\"startTime\":[0,0,1]},"
+                    "{\"bpm\":200.0,\"startTime\":[%d,0,1]}],",
+               rng.uniform(120.0, 240.0), chart.total_beats / 2);
+    out += "\"META\":{\"RPEVersion\":150,\"background\":\"bench.png\",\"charter\":\"bench\","
+           "\"composer\":\"bench\",\"id\":\"1\",\"level\":\"IN Lv.15\",\"name\":\"Benchmark\","
+           "\"offset\":0,\"song\":\"bench.ogg\"},";
+    out += "\"judgeLineGroup\":[\"Default\"],\"judgeLineList\":[";
+
+    for (int line = 0; line < config.judge_lines; ++line) {
+        if (line > 0) out += ',';
+        append_fmt(out, "{\"Group\":0,\"Name\":\"Line %d\",\"Texture\":\"line.png\","
+                        "\"bpmfactor\":1.0,\"father\":-1,\"isCover\":1,\"numOfNotes\":%d,\"zOrder\":0,",
+                   line, config.notes);
+
+        out += "\"eventLayers\":[";
+        for (int layer = 0; layer < config.layers; ++layer) {
+            if (layer > 0) out += ',';
+            out += '{';
+            for (int type = 0; type < 5; ++type) {
+                if (type > 0) out += ',';
+                append_fmt(out, "\"%s\":", event_types[type]);
+                append_event_array(out, rng, config.events_per_type, chart.total_beats,
+                                   type == 4, chart.event_count);
+            }
+            out += '}';
+        }
+        out += "],\"extended\":{";
+        for (int arr = 0; arr < config.extended_arrays; ++arr) {
+            if (arr > 0) out += ',';
+            append_fmt(out, "\"extendedEvents%d\":", arr);
+            append_event_array(out, rng, config.extended_events, chart.total_beats,
+                               false, chart.special_event_count);
+        }
+        out += "},\"notes\":";
+        append_notes(out, rng, config.notes, chart.total_beats, chart.note_count);
+        out += '}';
+    }
+    out += "],\"multiLineString\":\"\",\"multiScale\":1.0}";
+    return chart;
+}
+
+std::string make_pez(const std::string& chart_json, size_t music_bytes) {
+    mz_zip_archive zip;
+    memset(&zip, 0, sizeof(zip));
+    if (!mz_zip_writer_init_heap(&zip, 0, chart_json.size() / 4 + music_bytes + 4096)) {
+        return "";
+    }
+
+    static const char info[] = "#\nName: Benchmark\nSong: bench.ogg\nPicture: bench.png\n"
+                               "Chart: bench.json\nLevel: IN Lv.15\nComposer: bench\nCharter: bench\n";
+    std::vector<unsigned char> music(music_bytes);
+    Rng rng(music_bytes);
+    for (auto& b : music) b = static_cast<unsigned char>(rng.next());
+
+    bool ok = mz_zip_writer_add_mem(&zip, "info.txt", info, sizeof(info) - 1, MZ_DEFAULT_LEVEL) &&
+              mz_zip_writer_add_mem(&zip, "bench.ogg", music.data(), music.size(), MZ_NO_COMPRESSION) &&
+              mz_zip_writer_add_mem(&zip, "bench.json", chart_json.data(), chart_json.size(), MZ_DEFAULT_LEVEL);
+
+    void* buf = nullptr;
+    size_t size = 0;
+    std::string pez;
+    if (ok && mz_zip_writer_finalize_heap_archive(&zip, &buf, &size)) {
+        pez.assign(static_cast<const char*>(buf), size);
+    }
+    mz_zip_writer_end(&zip);
+    if (buf) free(buf);
+    return pez;
+}
+
+std::string make_merge_form(const std::string& chart_json,
+                            const std::vector<MergeWindow>& windows,
+                            bool truncate_start, bool truncate_end) {
+    json form = {
+        {"firstCardId", 0},
+        {"truncateStart", truncate_start},
+        {"truncateEnd", truncate_end},
+        {"cards", json::array()}
+    };
+    for (size_t i = 0; i < windows.size(); ++i) {
+        form["cards"].push_back({
+            {"id", static_cast<int>(i)},
+            {"timeControls", {
+                {"inputs", {windows[i].start_measure, 0, 1, windows[i].end_measure, 0, 1}},
+                {"checkboxes", {true, true}}
+            }},
+            {"independentJudgeLines", json::array()},
+            {"chartJson", chart_json}
+        });
+    }
+    return form.dump();
+}
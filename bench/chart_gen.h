@@ -0,0 +1,45 @@
+#pragma once
+
+/* 基准测试用的 RPE 谱面生成器
+ * 同一组参数与种子总是生成完全相同的谱面，便于对比不同版本的耗时。
+ */
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+struct ChartGenConfig {
+    int judge_lines = 30;        // 判定线数量
+    int layers = 2;              // 每条判定线的事件层数（合并只使用前 4 层）
+    int events_per_type = 100;   // 每层每种事件的数量
+    int notes = 200;             // 每条判定线的音符数量
+    int extended_arrays = 1;     // extended 中的数组个数
+    int extended_events = 20;    // extended 中每个数组的事件数量
+    uint64_t seed = 1;
+};
+
+struct GeneratedChart {
+    std::string json;
+    size_t event_count;          // eventLayers 中的事件总数
+    size_t special_event_count;  // extended 中的事件总数
+    size_t note_count;           // 音符总数
+    int total_beats;             // 谱面覆盖的拍数（小节号上限）
+};
+
+GeneratedChart generate_chart(const ChartGenConfig& config);
+
+// 打包成 PEZ：info.txt、谱面 JSON（deflate）与指定大小的伪音频（store）
+std::string make_pez(const std::string& chart_json, size_t music_bytes);
+
+struct MergeWindow {
+    int start_measure;
+    int end_measure;
+};
+
+/* 生成 finalize_merge 所用的合并表单
+ * 每张卡片使用同一份谱面的一个时间窗口，事件与音符都复制。
+ */
+std::string make_merge_form(const std::string& chart_json,
+                            const std::vector<MergeWindow>& windows,
+                            bool truncate_start, bool truncate_end);
@@ -1,9 +1,18 @@
 // chartStorage.js
+
+// 记录中保存的谱面及其格式
+export function chartOf(record) {
+    if (record?.packedChart) return { format: 'packed', data: record.packedChart };
+    if (record?.pezData) return { format: 'pez', data: record.pezData };
+    return null;
+}
+
 export class ChartStorage {
     constructor() {
         this.dbName = 'ChartDatabase';
         this.storeName = 'chartData';
-        this.version = 1;
+        // 版本 2 起 JSON 谱面以压缩后的字节（packedChart）保存，不再保存 JS 字符串
+        this.version = 2;
         this.db = null;
     }
 
@@ -21,6 +30,9 @@ export class ChartStorage {
                 // 若存储仓库不存在则创建（以 cardId 为唯一键）
                 if (!this.db.objectStoreNames.contains(this.storeName)) {
                 this.db.createObjectStore(this.storeName, { keyPath: 'cardId' });
+                } else if (event.oldVersion < 2) {
+                    // 旧版本的记录是 UTF-16 的 JSON 字符串，直接丢弃
+                    event.target.transaction.objectStore(this.storeName).clear();
                 }
             };
 
@@ -39,10 +51,11 @@ export class ChartStorage {
     /**
      * 存储谱面 JSON 数据
      * @param {string|number} cardId 卡片唯一标识
-     * @param {string} jsonStr 原始 JSON 字符串
+     * @param {ArrayBuffer} packedChart WASM 模块压缩过的谱面（loadChart 以 pack 载入时得到），
+     *        约为原始 JSON 的八分之一，读回后直接交给模块解压解析
      * @returns {Promise<boolean>} 存储成功返回 true
      */
-    saveChart(cardId, jsonStr) {
+    saveChart(cardId, packedChart) {
         return new Promise((resolve, reject) => {
             if (!this.db) {
                 reject(new Error('数据库未打开，请先调用 open()'));
@@ -54,7 +67,32 @@ export class ChartStorage {
             // 存储数据（包含时间戳用于后续清理）
             const request = store.put({
                 cardId,
-                jsonStr,
+                packedChart,
+                timestamp: Date.now()
+            });
+
+            request.onsuccess = () => resolve(true);
+            request.onerror = () => reject(request.error);
+        });
+    }
+
+    /**
+     * 存储 PEZ 原始数据（谱面由 WASM 端直接从中解压解析）
+     * @param {string|number} cardId 卡片唯一标识
+     * @param {ArrayBuffer} pezData PEZ 文件内容
+     * @returns {Promise<boolean>} 存储成功返回 true
+     */
+    savePez(cardId, pezData) {
+        return new Promise((resolve, reject) => {
+            if (!this.db) {
+                reject(new Error('数据库未打开，请先调用 open()'));
+                return;
+            }
+            const transaction = this.db.transaction([this.storeName], 'readwrite');
+            const store = transaction.objectStore(this.storeName);
+            const request = store.put({
+                cardId,
+                pezData,
                 timestamp: Date.now()
             });
 
@@ -64,9 +102,83 @@ export class ChartStorage {
     }
 
     /**
-     * 读取谱面 JSON 数据
+     * 在卡片已有的记录上附加解析结果的快照与文件名，刷新页面后以快照恢复
+     * @param {string|number} cardId 卡片唯一标识
+     * @param {ArrayBuffer|null} snapshot WASM 模块生成的谱面快照，null 表示只记下文件名
+     * @param {string} fileName 显示在卡片上的文件名
+     * @returns {Promise<boolean>} 卡片没有记录（原始文件未能存储）时返回 false
+     */
+    saveSnapshot(cardId, snapshot, fileName) {
+        return new Promise((resolve, reject) => {
+            if (!this.db) {
+                reject(new Error('数据库未打开，请先调用 open()'));
+                return;
+            }
+            // 读取与写入放在同一个事务中，期间记录不会被别处替换
+            const transaction = this.db.transaction([this.storeName], 'readwrite');
+            const store = transaction.objectStore(this.storeName);
+            const request = store.get(cardId);
+
+            request.onsuccess = () => {
+                const record = request.result;
+                if (!record) {
+                    resolve(false);
+                    return;
+                }
+                record.snapshot = snapshot;
+                record.fileName = fileName;
+                const putRequest = store.put(record);
+                putRequest.onsuccess = () => resolve(true);
+                putRequest.onerror = () => reject(putRequest.error);
+            };
+            request.onerror = () => reject(request.error);
+        });
+    }
+
+    /**
+     * 原样写入一条记录（恢复会话时调整卡片编号用）
+     * @param {Object} record 带 cardId 的完整记录
+     * @returns {Promise<boolean>} 存储成功返回 true
+     */
+    saveRecord(record) {
+        return new Promise((resolve, reject) => {
+            if (!this.db) {
+                reject(new Error('数据库未打开，请先调用 open()'));
+                return;
+            }
+            const transaction = this.db.transaction([this.storeName], 'readwrite');
+            const store = transaction.objectStore(this.storeName);
+            const request = store.put(record);
+
+            request.onsuccess = () => resolve(true);
+            request.onerror = () => reject(request.error);
+        });
+    }
+
+    /**
+     * 读取所有记录
+     * @returns {Promise<Object[]>} 各卡片的 { cardId, packedChart | pezData, snapshot, fileName, timestamp }
+     */
+    getAll() {
+        return new Promise((resolve, reject) => {
+            if (!this.db) {
+                reject(new Error('数据库未打开，请先调用 open()'));
+                return;
+            }
+            const transaction = this.db.transaction([this.storeName], 'readonly');
+            const store = transaction.objectStore(this.storeName);
+            const request = store.getAll();
+
+            request.onsuccess = () => resolve(request.result);
+            request.onerror = () => reject(request.error);
+        });
+    }
+
+    /**
+     * 读取谱面数据
      * @param {string|number} cardId 卡片唯一标识
-     * @returns {Promise<string|null>} 原始 JSON 字符串（不存在则返回 null）
+     * @returns {Promise<{format: 'packed'|'pez', data: ArrayBuffer}|null>}
+     *          压缩的 JSON 谱面或 PEZ 数据，可直接交给 ChartWorker.loadChart（不存在则返回 null）
      */
     getChart(cardId) {
         return new Promise((resolve, reject) => {
@@ -79,7 +191,7 @@ export class ChartStorage {
             const store = transaction.objectStore(this.storeName);
             const request = store.get(cardId);
 
-            request.onsuccess = () => resolve(request.result?.jsonStr || null);
+            request.onsuccess = () => resolve(chartOf(request.result));
             request.onerror = () => reject(request.error);
         });
     }
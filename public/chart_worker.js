@@ -0,0 +1,186 @@
+// chart_worker.js
+// 在专用 Worker 中运行 WASM 模块，解析与合并都不占用页面主线程。
+// 页面通过 chart_worker_client.js 发送 { id, type, ...参数 }，这里回复 { id, ok, result | error }；
+// 谱面与结果以 ArrayBuffer 转移（transfer），不在两个线程之间复制。
+
+var Module = {
+    onRuntimeInitialized() {
+        self.postMessage({ type: 'ready' });
+    }
+};
+importScripts('json_parser.js');
+
+// 结果分块的大小，页面直接用这些块拼成 Blob
+const RESULT_CHUNK_SIZE = 16 * 1024 * 1024; // 16MB/块
+
+// 把 ArrayBuffer 复制进 wasm 堆，返回指针；调用者负责 free（或交给模块）
+function copyToHeap(buffer) {
+    const bytes = new Uint8Array(buffer);
+    const ptr = Module._malloc(bytes.length);
+    Module.HEAPU8.set(bytes, ptr);
+    return ptr;
+}
+
+const handlers = {
+    /**
+     * 载入谱面并在模块中登记
+     * @param {{format: 'json'|'pez'|'packed', data: ArrayBuffer, pack: boolean}} msg
+     *        packed 为 deflateChart 压缩过的 JSON（IndexedDB 中保存的形式），在模块内解压后解析；
+     *        pack 为 true 时顺带压缩 JSON 谱面，结果放在 packed 中
+     * @returns 谱面统计信息（与 parse_json 的返回相同）以及句柄 handle，解析失败时 handle 为 0；
+     *          要求压缩时另有 packed（ArrayBuffer，转移给页面；内存不足时为 null）
+     */
+    loadChart({ format, data, pack }) {
+        const ptr = copyToHeap(data);
+        let result;
+        if (format === 'pez') {
+            // 原包交给模块保留，导出 PEZ 时复制其中的资源，不要 free
+            result = JSON.parse(Module.UTF8ToString(Module._load_pez(ptr, data.byteLength)));
+        } else if (format === 'packed') {
+            result = JSON.parse(Module.UTF8ToString(Module._load_deflated_chart(ptr, data.byteLength)));
+            Module._free(ptr);
+        } else {
+            result = JSON.parse(Module.UTF8ToString(Module._load_chart(ptr, data.byteLength)));
+            if (pack && result.error === 0) {
+                result.packed = null;
+                if (Module._deflate_chart(ptr, data.byteLength) === 0) {
+                    const base = Module._deflated_data();
+                    result.packed = Module.HEAPU8.slice(base, base + Module._deflated_size()).buffer;
+                    Module._release_deflated();
+                }
+            }
+            Module._free(ptr);
+        }
+        return result;
+    },
+
+    /**
+     * 由快照恢复谱面（load_chart_snapshot），PEZ 卡片再附上原包以便导出 PEZ
+     * @param {{snapshot: ArrayBuffer, pezData: ArrayBuffer|null}} msg
+     * @returns 与 loadChart 相同；快照无效时 error 不为 0，前端应改用原始文件载入
+     */
+    restoreChart({ snapshot, pezData }) {
+        const ptr = copyToHeap(snapshot);
+        const result = JSON.parse(Module.UTF8ToString(Module._load_chart_snapshot(ptr, snapshot.byteLength)));
+        Module._free(ptr);
+        if (result.error === 0 && pezData) {
+            // 原包交给模块保留，不要 free
+            Module._attach_pez(result.handle, copyToHeap(pezData), pezData.byteLength);
+        }
+        return result;
+    },
+
+    /**
+     * 生成谱面的二进制快照
+     * @param {{handle: number}} msg
+     * @returns {ArrayBuffer|null} 快照（转移给页面），句柄无效时为 null
+     */
+    snapshot({ handle }) {
+        if (Module._make_chart_snapshot(handle) !== 0) return null;
+        const base = Module._snapshot_data();
+        const buffer = Module.HEAPU8.slice(base, base + Module._snapshot_size()).buffer;
+        Module._release_snapshot();
+        return buffer;
+    },
+
+    hasChart({ handle }) {
+        return Module._has_chart(handle) !== 0;
+    },
+
+    releaseChart({ handle }) {
+        Module._release_chart(handle);
+        return true;
+    },
+
+    /**
+     * 调整已解析谱面常驻内存的预算，超出时最久未用的谱面换出为压缩的紧凑形式
+     * @param {{bytes: number}} msg 0 表示不限
+     */
+    setChartBudget({ bytes }) {
+        Module._set_chart_budget(bytes);
+        return true;
+    },
+
+    // 谱面登记表的占用（get_chart_cache_stats）
+    cacheStats() {
+        return JSON.parse(Module.UTF8ToString(Module._get_chart_cache_stats()));
+    },
+
+    /**
+     * 按设置表单合并已载入的谱面，结果留在模块中等待 fetchResult
+     * @param {{form: string, indent: number, packPezHandle: number|null}} msg
+     *        packPezHandle 不为 null 时，以该句柄对应的 PEZ 原包打包结果
+     * @returns {{status: number, packStatus: number|null, size: number}}
+     */
+    merge({ form, indent, packPezHandle }) {
+        const formLength = Module.lengthBytesUTF8(form) + 1;
+        const formPtr = Module._malloc(formLength);
+        Module.stringToUTF8(form, formPtr, formLength);
+        const status = Module._merge_cards(formPtr, formLength - 1, indent);
+        Module._free(formPtr);
+
+        let packStatus = null;
+        if (status === 0 && packPezHandle !== null && packPezHandle !== undefined) {
+            packStatus = Module._has_pez(packPezHandle)
+                ? Module._package_merge_result(packPezHandle)
+                : -3;
+        }
+        return { status, packStatus, size: Module._merge_result_size() };
+    },
+
+    /**
+     * 取走最近一次合并的结果，随后释放模块中的缓冲区
+     * @returns {ArrayBuffer[]} 按顺序排列的结果分块（转移给页面）
+     */
+    fetchResult() {
+        const size = Module._merge_result_size();
+        const parts = [];
+        for (let offset = 0; offset < size; offset += RESULT_CHUNK_SIZE) {
+            const base = Module._merge_result_data();
+            const end = Math.min(offset + RESULT_CHUNK_SIZE, size);
+            parts.push(Module.HEAPU8.slice(base + offset, base + end).buffer);
+        }
+        Module._release_merge_result();
+        return parts;
+    },
+
+    /**
+     * 各阶段的耗时与字节数以及堆的峰值占用（get_perf_report）
+     * @param {{reset: boolean}} msg reset 为 true 时读取后清零
+     */
+    perfReport({ reset }) {
+        const report = JSON.parse(Module.UTF8ToString(Module._get_perf_report()));
+        if (reset) Module._reset_perf_report();
+        return report;
+    },
+
+    /**
+     * 当前的分配次数、占用与峰值（get_alloc_stats）；模块未以 ALLOC_TRACKING 构建时 enabled 为 false
+     */
+    allocStats() {
+        return JSON.parse(Module.UTF8ToString(Module._get_alloc_stats()));
+    }
+};
+
+// 回复中需要转移而不是复制的 ArrayBuffer
+function transferList(result) {
+    if (result instanceof ArrayBuffer) return [result];
+    if (Array.isArray(result)) return result.filter(item => item instanceof ArrayBuffer);
+    if (result && result.packed instanceof ArrayBuffer) return [result.packed];
+    return [];
+}
+
+self.onmessage = (event) => {
+    const { id, type, ...payload } = event.data;
+    const handler = handlers[type];
+    if (!handler) {
+        self.postMessage({ id, ok: false, error: `未知的请求类型: ${type}` });
+        return;
+    }
+    try {
+        const result = handler(payload);
+        self.postMessage({ id, ok: true, result }, transferList(result));
+    } catch (error) {
+        self.postMessage({ id, ok: false, error: String(error) });
+    }
+};
@@ -0,0 +1,122 @@
+// chart_worker_client.js
+// chart_worker.js 的页面端封装：每个请求返回一个 Promise，谱面数据以转移的方式交给 Worker。
+export class ChartWorker {
+    constructor(url = 'chart_worker.js') {
+        this.worker = new Worker(url);
+        this.nextId = 1;
+        this.pending = new Map();
+
+        let resolveReady;
+        let rejectReady;
+        /** WASM 模块初始化完成后 resolve */
+        this.ready = new Promise((resolve, reject) => {
+            resolveReady = resolve;
+            rejectReady = reject;
+        });
+
+        this.worker.onmessage = (event) => {
+            const message = event.data;
+            if (message.type === 'ready') {
+                resolveReady();
+                return;
+            }
+            const request = this.pending.get(message.id);
+            if (!request) return;
+            this.pending.delete(message.id);
+            message.ok ? request.resolve(message.result) : request.reject(new Error(message.error));
+        };
+
+        this.worker.onerror = (event) => {
+            console.error('Worker 出错:', event.message);
+            rejectReady(new Error(event.message));
+            for (const request of this.pending.values()) {
+                request.reject(new Error(event.message));
+            }
+            this.pending.clear();
+        };
+    }
+
+    call(type, payload = {}, transfer = []) {
+        const id = this.nextId++;
+        return new Promise((resolve, reject) => {
+            this.pending.set(id, { resolve, reject });
+            this.worker.postMessage({ id, type, ...payload }, transfer);
+        });
+    }
+
+    /**
+     * 载入谱面，data 会被转移给 Worker，之后在页面中不可再用
+     * @param {'json'|'pez'|'packed'} format 文件格式，packed 为之前 pack 得到的压缩谱面
+     * @param {ArrayBuffer} data 文件内容（JSON 为 UTF-8 字节）
+     * @param {boolean} pack 是否顺带把 JSON 谱面压缩成 packed 形式，用于存入 IndexedDB
+     * @returns {Promise<Object>} 谱面统计信息，handle 为之后引用这份谱面的句柄（失败时为 0）；
+     *          pack 时另有 packed（ArrayBuffer，内存不足时为 null）
+     */
+    loadChart(format, data, pack = false) {
+        return this.call('loadChart', { format, data, pack }, [data]);
+    }
+
+    /**
+     * 由快照恢复谱面，snapshot 与 pezData 都会被转移给 Worker
+     * @param {ArrayBuffer} snapshot snapshot() 得到的快照
+     * @param {ArrayBuffer|null} pezData PEZ 卡片的原包，导出 PEZ 时使用
+     * @returns {Promise<Object>} 与 loadChart 相同；快照无效时 error 不为 0
+     */
+    restoreChart(snapshot, pezData = null) {
+        const transfer = pezData ? [snapshot, pezData] : [snapshot];
+        return this.call('restoreChart', { snapshot, pezData }, transfer);
+    }
+
+    /** @returns {Promise<ArrayBuffer|null>} 谱面的二进制快照，句柄无效时为 null */
+    snapshot(handle) {
+        return this.call('snapshot', { handle });
+    }
+
+    /** @returns {Promise<boolean>} 句柄是否仍然有效 */
+    hasChart(handle) {
+        return this.call('hasChart', { handle });
+    }
+
+    releaseChart(handle) {
+        return this.call('releaseChart', { handle });
+    }
+
+    /** @param {number} bytes 已解析谱面常驻内存的预算，0 表示不限 */
+    setChartBudget(bytes) {
+        return this.call('setChartBudget', { bytes });
+    }
+
+    /** @returns {Promise<Object>} 常驻与已换出的谱面数、占用以及换出/换回次数 */
+    cacheStats() {
+        return this.call('cacheStats');
+    }
+
+    /**
+     * 合并已载入的谱面
+     * @param {string} form 设置表单（JSON 字符串），卡片以 handle 引用已载入的谱面
+     * @param {number} indent 缩进空格数，-1 表示紧凑输出
+     * @param {number|null} packPezHandle 以该句柄对应的 PEZ 原包打包结果，null 表示输出 JSON
+     * @returns {Promise<{status: number, packStatus: number|null, size: number}>}
+     */
+    merge(form, indent, packPezHandle = null) {
+        return this.call('merge', { form, indent, packPezHandle });
+    }
+
+    /** @returns {Promise<ArrayBuffer[]>} 合并结果的分块，可直接用于构造 Blob */
+    fetchResult() {
+        return this.call('fetchResult');
+    }
+
+    /**
+     * @param {boolean} reset 读取后是否清零
+     * @returns {Promise<Object>} 各阶段的耗时（ms）、字节数、次数以及堆的峰值占用
+     */
+    perfReport(reset = false) {
+        return this.call('perfReport', { reset });
+    }
+
+    /** @returns {Promise<Object>} 分配次数、当前占用与峰值（字节），未启用统计时 enabled 为 false */
+    allocStats() {
+        return this.call('allocStats');
+    }
+}
@@ -0,0 +1,117 @@
+#include "alloc_tracking.h"
+
+#ifdef CHART_ALLOC_TRACKING
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+// 每块分配前留出一段记录大小，保持 max_align_t 的对齐
+constexpr size_t HEADER_SIZE = alignof(std::max_align_t) > sizeof(size_t)
+                                   ? alignof(std::max_align_t) : sizeof(size_t);
+
+std::atomic<uint64_t> allocations{0};
+std::atomic<uint64_t> frees{0};
+std::atomic<uint64_t> live_bytes{0};
+std::atomic<uint64_t> peak_bytes{0};
+std::atomic<uint64_t> total_bytes{0};
+
+std::atomic<unsigned> watch_active[ALLOC_WATCH_SLOTS];
+std::atomic<uint64_t> watch_peak[ALLOC_WATCH_SLOTS];
+
+void raise_to(std::atomic<uint64_t>& peak, uint64_t value) {
+    uint64_t current = peak.load(std::memory_order_relaxed);
+    while (current < value &&
+           !peak.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+void* tracked_alloc(size_t size) {
+    void* block = std::malloc(size + HEADER_SIZE);
+    if (!block) return nullptr;
+    *static_cast<size_t*>(block) = size;
+
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    total_bytes.fetch_add(size, std::memory_order_relaxed);
+    uint64_t live = live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+    raise_to(peak_bytes, live);
+    for (size_t i = 0; i < ALLOC_WATCH_SLOTS; ++i) {
+        if (watch_active[i].load(std::memory_order_relaxed) > 0) raise_to(watch_peak[i], live);
+    }
+    return static_cast<char*>(block) + HEADER_SIZE;
+}
+
+void tracked_free(void* ptr) {
+    if (!ptr) return;
+    void* block = static_cast<char*>(ptr) - HEADER_SIZE;
+    frees.fetch_add(1, std::memory_order_relaxed);
+    live_bytes.fetch_sub(*static_cast<size_t*>(block), std::memory_order_relaxed);
+    std::free(block);
+}
+
+void* tracked_alloc_or_fail(size_t size) {
+    void* ptr = tracked_alloc(size);
+    if (!ptr) {
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS)
+        throw std::bad_alloc();
+#else
+        // WASM 以 -fno-exceptions 构建，内存不足时无法抛出
+        std::abort();
+#endif
+    }
+    return ptr;
+}
+
+}  // namespace
+
+AllocStats alloc_stats() {
+    AllocStats stats;
+    stats.allocations = allocations.load(std::memory_order_relaxed);
+    stats.frees = frees.load(std::memory_order_relaxed);
+    stats.live_bytes = live_bytes.load(std::memory_order_relaxed);
+    stats.peak_bytes = peak_bytes.load(std::memory_order_relaxed);
+    stats.total_bytes = total_bytes.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void alloc_reset_peak() {
+    peak_bytes.store(live_bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    for (std::atomic<uint64_t>& peak : watch_peak) peak.store(0, std::memory_order_relaxed);
+}
+
+void alloc_watch_begin(size_t slot) {
+    watch_active[slot].fetch_add(1, std::memory_order_relaxed);
+    raise_to(watch_peak[slot], live_bytes.load(std::memory_order_relaxed));
+}
+
+void alloc_watch_end(size_t slot) {
+    watch_active[slot].fetch_sub(1, std::memory_order_relaxed);
+}
+
+uint64_t alloc_watch_peak(size_t slot) {
+    return watch_peak[slot].load(std::memory_order_relaxed);
+}
+
+// 全局分配函数的替换；对齐分配（align_val_t）仍走标准库，不计入统计
+void* operator new(size_t size) { return tracked_alloc_or_fail(size); }
+void* operator new[](size_t size) { return tracked_alloc_or_fail(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return tracked_alloc(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return tracked_alloc(size); }
+void operator delete(void* ptr) noexcept { tracked_free(ptr); }
+void operator delete[](void* ptr) noexcept { tracked_free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { tracked_free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { tracked_free(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { tracked_free(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { tracked_free(ptr); }
+
+#else
+
+AllocStats alloc_stats() { return AllocStats(); }
+void alloc_reset_peak() {}
+void alloc_watch_begin(size_t) {}
+void alloc_watch_end(size_t) {}
+uint64_t alloc_watch_peak(size_t) { return 0; }
+
+#endif
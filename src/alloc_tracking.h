@@ -0,0 +1,41 @@
+#pragma once
+
+/* 分配统计
+ * 以 -DALLOC_TRACKING=ON 构建时替换全局的 operator new / delete，统计分配次数、当前占用与峰值占用，
+ * 并可按“观察槽”记录某段时间内的峰值（PerfScope 以阶段编号作为槽，得到每个阶段的峰值占用）。
+ * 只统计 C++ 的分配（判定线、谱面树、json 等）；miniz 与页面直接 malloc 的缓冲区不在其中，
+ * 这部分由 perf_report_json 中 dlmalloc 的 heapInUse/heapHighWater 反映。
+ * 未启用时各函数都可以调用，统计值始终为 0。
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+struct AllocStats {
+    uint64_t allocations = 0;   // 分配次数
+    uint64_t frees = 0;         // 释放次数
+    uint64_t live_bytes = 0;    // 当前占用
+    uint64_t peak_bytes = 0;    // 自上次 alloc_reset_peak 以来的峰值占用
+    uint64_t total_bytes = 0;   // 累计分配的字节数
+};
+
+constexpr size_t ALLOC_WATCH_SLOTS = 8;
+
+constexpr bool alloc_tracking_enabled() {
+#ifdef CHART_ALLOC_TRACKING
+    return true;
+#else
+    return false;
+#endif
+}
+
+AllocStats alloc_stats();
+// 把峰值重置为当前占用，并清空各观察槽的峰值
+void alloc_reset_peak();
+
+/* 观察槽：begin 与 end 之间（可以嵌套、可以多个线程同时进入）每次分配后都会更新该槽的峰值
+ * 峰值是整个进程的占用，不只是这段代码自己分配的部分
+ */
+void alloc_watch_begin(size_t slot);
+void alloc_watch_end(size_t slot);
+uint64_t alloc_watch_peak(size_t slot);
@@ -0,0 +1,55 @@
+#pragma once
+
+/* 精确的拍数表示
+ * RPE 的时间是 [小节, 分子, 分母]，换算成 double 再比较既要做除法，
+ * 也可能把 1/3 拍这类边界上的事件判错。这里保存为 整数部分 + 真分数，
+ * 比较时先比整数部分，再对分数做 64 位交叉相乘，全程没有舍入。
+ */
+
+#include <cstdint>
+
+struct Beat {
+    int64_t whole;   // 整数部分（向下取整）
+    int64_t num;     // 分子，0 <= num < den
+    int64_t den;     // 分母，> 0，与 num 互质
+
+    static Beat from_time(int64_t measure, int64_t numerator, int64_t denominator) {
+        if (denominator == 0) denominator = 1; // 避免除零错误
+        if (denominator < 0) {
+            numerator = -numerator;
+            denominator = -denominator;
+        }
+        // 向下取整，使余数落在 [0, denominator)
+        int64_t q = numerator / denominator;
+        int64_t r = numerator % denominator;
+        if (r < 0) {
+            q -= 1;
+            r += denominator;
+        }
+        int64_t g = gcd(r, denominator);
+        return {measure + q, r / g, denominator / g};
+    }
+
+    // 分子分母都不超过 2^31，交叉相乘不会溢出 int64
+    friend bool operator<(const Beat& a, const Beat& b) {
+        if (a.whole != b.whole) return a.whole < b.whole;
+        return a.num * b.den < b.num * a.den;
+    }
+    friend bool operator>(const Beat& a, const Beat& b) { return b < a; }
+    friend bool operator<=(const Beat& a, const Beat& b) { return !(b < a); }
+    friend bool operator>=(const Beat& a, const Beat& b) { return !(a < b); }
+    friend bool operator==(const Beat& a, const Beat& b) {
+        return a.whole == b.whole && a.num == b.num && a.den == b.den;
+    }
+    friend bool operator!=(const Beat& a, const Beat& b) { return !(a == b); }
+
+private:
+    static int64_t gcd(int64_t a, int64_t b) {
+        while (b != 0) {
+            int64_t t = a % b;
+            a = b;
+            b = t;
+        }
+        return a > 0 ? a : 1;
+    }
+};
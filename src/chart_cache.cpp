@@ -0,0 +1,242 @@
+#include <cstdlib>
+
+#include "chart_cache.h"
+#include "json_writer.h"
+#include "perf.h"
+#include "../include/miniz/miniz.h"
+
+// 换出谱面时用最快的压缩级别，换出发生在载入与合并的过程中
+static std::shared_ptr<const std::vector<unsigned char>> pack_chart(const ParsedChart& chart,
+                                                                    size_t& json_len) {
+    OutputBuffer out;
+    JsonWriter writer(out, -1);
+    write_chart(chart, writer);
+    if (out.failed()) return nullptr;
+
+    mz_ulong packed_len = mz_compressBound(static_cast<mz_ulong>(out.size()));
+    auto packed = std::make_shared<std::vector<unsigned char>>(packed_len);
+    if (mz_compress2(packed->data(), &packed_len, reinterpret_cast<const unsigned char*>(out.data()),
+                     static_cast<mz_ulong>(out.size()), MZ_BEST_SPEED) != MZ_OK) {
+        return nullptr;
+    }
+    packed->resize(packed_len);
+    packed->shrink_to_fit();
+    json_len = out.size();
+    return packed;
+}
+
+static std::shared_ptr<const ParsedChart> unpack_chart(const std::vector<unsigned char>& packed,
+                                                       size_t json_len) {
+    PerfScope scope(PerfPhase::ChartParse, json_len);
+    char* json_str = static_cast<char*>(malloc(json_len + 1));
+    if (!json_str) return nullptr;
+    mz_ulong out_len = static_cast<mz_ulong>(json_len);
+    auto chart = std::make_shared<ParsedChart>();
+    bool ok = mz_uncompress(reinterpret_cast<unsigned char*>(json_str), &out_len,
+                            packed.data(), static_cast<mz_ulong>(packed.size())) == MZ_OK &&
+        out_len == json_len && build_chart_store(json_str, json_len, *chart);
+    free(json_str);
+    return ok ? chart : nullptr;
+}
+
+int ChartCache::add(std::shared_ptr<const ParsedChart> chart) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    int handle = next_handle_++;
+    insert_locked(handle, std::move(chart));
+    evict(handles_[handle], lock);
+    return handle;
+}
+
+int ChartCache::add(std::shared_ptr<const ParsedChart> chart, uint64_t hash, const ParseResult& stats) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    int handle = next_handle_++;
+    Content& content = insert_locked(handle, std::move(chart));
+    uint64_t id = handles_[handle];
+    // 哈希已经对应别的内容时（两次载入同时进行）保留先登记的那份
+    if (by_hash_.emplace(hash, id).second) {
+        content.has_hash = true;
+        content.hash = hash;
+        content.stats = stats;
+    }
+    evict(id, lock);
+    return handle;
+}
+
+int ChartCache::share(uint64_t hash, ParseResult& stats) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = by_hash_.find(hash);
+    if (it == by_hash_.end()) return 0;
+    Content& content = contents_[it->second];
+    int handle = next_handle_++;
+    handles_[handle] = it->second;
+    content.refs++;
+    content.last_used = ++clock_;
+    stats = content.stats;
+    hash_hits_++;
+    return handle;
+}
+
+bool ChartCache::find_hash(uint64_t hash, ParseResult* stats) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = by_hash_.find(hash);
+    if (it == by_hash_.end()) return false;
+    if (stats) *stats = contents_.at(it->second).stats;
+    return true;
+}
+
+bool ChartCache::hash_of(int handle, uint64_t& hash) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = handles_.find(handle);
+    if (it == handles_.end()) return false;
+    const Content& content = contents_.at(it->second);
+    hash = content.hash;
+    return content.has_hash;
+}
+
+bool ChartCache::stats_of(int handle, ParseResult& stats) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = handles_.find(handle);
+    if (it == handles_.end()) return false;
+    const Content& content = contents_.at(it->second);
+    if (!content.has_hash) return false;
+    stats = content.stats;
+    return true;
+}
+
+ChartCache::Content& ChartCache::insert_locked(int handle, std::shared_ptr<const ParsedChart> chart) {
+    uint64_t id = next_content_++;
+    handles_[handle] = id;
+    Content& content = contents_[id];
+    content.bytes = chart ? chart_memory_size(*chart) : 0;
+    content.chart = std::move(chart);
+    content.last_used = ++clock_;
+    content.refs = 1;
+    resident_bytes_ += content.bytes;
+    return content;
+}
+
+void ChartCache::release_locked(int handle) {
+    auto it = handles_.find(handle);
+    if (it == handles_.end()) return;
+    auto content_it = contents_.find(it->second);
+    handles_.erase(it);
+    Content& content = content_it->second;
+    if (--content.refs > 0) return;
+    if (content.chart) resident_bytes_ -= content.bytes;
+    if (content.has_hash) by_hash_.erase(content.hash);
+    contents_.erase(content_it);
+}
+
+std::shared_ptr<const ParsedChart> ChartCache::find(int handle) const {
+    std::shared_ptr<const std::vector<unsigned char>> packed;
+    size_t packed_len = 0;
+    uint64_t id = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = handles_.find(handle);
+        if (it == handles_.end()) return nullptr;
+        id = it->second;
+        Content& content = contents_.at(id);
+        content.last_used = ++clock_;
+        if (content.chart || !content.packed) return content.chart;
+        packed = content.packed;
+        packed_len = content.packed_len;
+    }
+
+    // 解压与解析在锁外进行；还原后腾出预算的换出同样在锁外压缩（evict），并行合并时各线程不必排队
+    std::shared_ptr<const ParsedChart> chart = unpack_chart(*packed, packed_len);
+    if (!chart) return nullptr;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = contents_.find(id);
+    // 还原期间被删除或已由别的线程还原时，以登记表中的为准
+    if (it == contents_.end() || it->second.packed != packed) return chart;
+    Content& content = it->second;
+    content.bytes = chart_memory_size(*chart);
+    content.chart = chart;
+    content.packed.reset();
+    content.packed_len = 0;
+    resident_bytes_ += content.bytes;
+    restores_++;
+    evict(id, lock);
+    return chart;
+}
+
+bool ChartCache::contains(int handle) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return handles_.count(handle) != 0;
+}
+
+void ChartCache::erase(int handle) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    release_locked(handle);
+}
+
+void ChartCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    handles_.clear();
+    contents_.clear();
+    by_hash_.clear();
+    resident_bytes_ = 0;
+}
+
+void ChartCache::set_budget(size_t bytes) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    budget_ = bytes;
+    evict(0, lock);
+}
+
+void ChartCache::evict(uint64_t keep, std::unique_lock<std::mutex>& lock) const {
+    while (budget_ != 0 && resident_bytes_ > budget_) {
+        // 在锁内挑出最久未用的谱面；别的线程正在换出的不再重复挑选
+        uint64_t victim_id = 0;
+        Content* victim = nullptr;
+        for (auto& [id, content] : contents_) {
+            if (id == keep || !content.chart || content.packing) continue;
+            if (!victim || content.last_used < victim->last_used) {
+                victim_id = id;
+                victim = &content;
+            }
+        }
+        if (!victim) return;
+        victim->packing = true;
+        std::shared_ptr<const ParsedChart> chart = victim->chart;
+        uint64_t last_used = victim->last_used;
+
+        // 写回与压缩在锁外进行，期间其他线程可以取用、还原谱面
+        lock.unlock();
+        size_t json_len = 0;
+        auto packed = pack_chart(*chart, json_len);
+        lock.lock();
+
+        // 压缩期间内容可能已被删除或被取用，与 find 一样以登记表中的为准
+        auto it = contents_.find(victim_id);
+        if (it != contents_.end()) it->second.packing = false;
+        // 内存不足、连压缩用的缓冲区都分配不出来时只能保持常驻
+        if (!packed) return;
+        if (it == contents_.end()) continue;
+        Content& content = it->second;
+        // 刚被取用过的谱面不再是最久未用的，留在内存里，重新挑选
+        if (content.chart != chart || content.last_used != last_used) continue;
+        resident_bytes_ -= content.bytes;
+        content.chart.reset();
+        content.bytes = 0;
+        content.packed = std::move(packed);
+        content.packed_len = json_len;
+        evictions_++;
+    }
+}
+
+ChartCacheStats ChartCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ChartCacheStats stats = {budget_, handles_.size(), 0, resident_bytes_, 0, 0, evictions_, restores_, hash_hits_};
+    for (const auto& [id, content] : contents_) {
+        if (content.chart) {
+            stats.resident_count++;
+        } else if (content.packed) {
+            stats.evicted_count++;
+            stats.evicted_bytes += content.packed->size();
+        }
+    }
+    return stats;
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+/* 已解析谱面的缓存
+ * 谱面在载入卡片时解析一次，统计信息返回给前端，紧凑存储与时间索引以句柄登记、留在模块里，
+ * 合并时直接复用，不必再把整份源文件塞进表单重新解析。
+ */
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "chart_core.h"
+#include "chart_store.h"
+
+enum class JsonBackend;   // json_insitu_parser.h
+
+/* 一次扫描同时得到统计信息和紧凑存储（chart_parser.cpp）
+ * 解析失败时返回 nullptr，错误码写入 stats。
+ */
+std::shared_ptr<ParsedChart> parse_chart(const char* json_str, size_t json_len, ParseResult& stats);
+// 同上，但只用指定的 JSON 解析器、失败时不换用另一个（供两种解析器的一致性检查使用）
+std::shared_ptr<ParsedChart> parse_chart_with(JsonBackend backend, const char* json_str, size_t json_len,
+                                              ParseResult& stats);
+
+/* 与 parse_chart 相同，但谱面可以分段送入（chart_parser.cpp）
+ * 用于边解压边解析，整份谱面 JSON 不必同时出现在内存里。
+ */
+class ChartStreamParser {
+public:
+    explicit ChartStreamParser(ParseResult& stats);
+    ~ChartStreamParser();
+
+    // 出错后返回 false，之后的输入会被忽略
+    bool feed(const char* data, size_t len);
+    // 输入结束；解析失败时返回 nullptr，错误码写入 stats
+    std::shared_ptr<ParsedChart> finish();
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+/* 从 PEZ 中找到谱面，用 miniz 的迭代解压接口逐块解压并直接解析（pez.cpp）
+ * 失败时返回 nullptr，stats.error_code 为 PezError 或解析错误码。
+ */
+std::shared_ptr<ParsedChart> parse_pez_chart(const unsigned char* pez_data, size_t data_size,
+                                             ParseResult& stats);
+
+// 缓存的占用情况
+struct ChartCacheStats {
+    size_t budget;           // 常驻谱面的字节预算，0 表示不限
+    size_t handle_count;     // 登记的句柄数（内容相同的句柄共享一份谱面）
+    size_t resident_count;   // 常驻的谱面数
+    size_t resident_bytes;   // 常驻谱面的估计占用
+    size_t evicted_count;    // 已换出为紧凑形式的谱面数
+    size_t evicted_bytes;    // 换出后的压缩数据大小
+    uint64_t evictions;      // 累计换出次数
+    uint64_t restores;       // 累计换回次数
+    uint64_t hash_hits;      // 按内容哈希命中、免去解析的次数
+};
+
+/* 已解析谱面的登记表
+ * 载入的谱面以句柄登记，解析结果常驻内存，合并时按句柄取用。
+ * 登记时带上输入字节的内容哈希（xxhash64），同一份文件再次载入时 share 直接返回首次解析的统计信息，
+ * 新句柄与原来的句柄共享同一份谱面，不再解析，也不多占内存；最后一个句柄释放时谱面才被删除。
+ * 设置了字节预算时，常驻谱面的估计占用超出预算就把最久未用的谱面换出：
+ * 写回紧凑的 RPE JSON（write_chart）再以 deflate 压缩保存，下次取用时解压并重新解析。
+ * 同时打开很多卡片时，常驻内存不超过预算（最近取用的那一份除外，它总是常驻）。
+ */
+class ChartCache {
+public:
+    explicit ChartCache(size_t budget = 0) : budget_(budget) {}
+
+    // 登记新的谱面，返回句柄（从 1 开始，不会重复使用）
+    int add(std::shared_ptr<const ParsedChart> chart);
+    // 同上，并按内容哈希记下谱面与解析时的统计信息，供之后的 share 使用
+    int add(std::shared_ptr<const ParsedChart> chart, uint64_t hash, const ParseResult& stats);
+    /* 内容哈希为 hash 的谱面已登记时，登记一个共享它的新句柄并返回，stats 为首次解析时的统计信息
+     * 没有登记过时返回 0
+     */
+    int share(uint64_t hash, ParseResult& stats);
+    // 内容哈希为 hash 的谱面是否已登记；命中时同时取出统计信息（stats 可为 nullptr）
+    bool find_hash(uint64_t hash, ParseResult* stats) const;
+    // 句柄登记时的内容哈希，没有哈希或句柄不存在时返回 false
+    bool hash_of(int handle, uint64_t& hash) const;
+    // 句柄对应谱面解析时的统计信息，没有内容哈希（未记下统计信息）或句柄不存在时返回 false
+    bool stats_of(int handle, ParseResult& stats) const;
+
+    // 取得谱面并记为最近使用；已换出的先还原，还原失败（内存不足）时返回 nullptr
+    std::shared_ptr<const ParsedChart> find(int handle) const;
+    // 只判断是否登记过，不会还原已换出的谱面
+    bool contains(int handle) const;
+    void erase(int handle);
+    void clear();
+
+    // 调整预算，超出时立即换出
+    void set_budget(size_t bytes);
+    ChartCacheStats stats() const;
+
+private:
+    // 一份谱面的内容，可被多个句柄共享
+    struct Content {
+        std::shared_ptr<const ParsedChart> chart;   // 常驻时非空
+        size_t bytes = 0;                            // 常驻时的估计占用
+        std::shared_ptr<const std::vector<unsigned char>> packed;   // 换出后的压缩数据
+        size_t packed_len = 0;                       // 压缩前（JSON）的长度
+        uint64_t last_used = 0;
+        int refs = 0;                                // 引用它的句柄数
+        bool packing = false;                        // 正在锁外换出
+        bool has_hash = false;
+        uint64_t hash = 0;
+        ParseResult stats = {};                      // 有内容哈希时为解析时的统计信息
+    };
+    using ContentMap = std::unordered_map<uint64_t, Content>;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<int, uint64_t> handles_;     // 句柄 → 内容编号
+    mutable ContentMap contents_;                    // 内容编号 → 内容
+    std::unordered_map<uint64_t, uint64_t> by_hash_;   // 内容哈希 → 内容编号
+    mutable uint64_t clock_ = 0;
+    mutable uint64_t evictions_ = 0;
+    mutable uint64_t restores_ = 0;
+    uint64_t hash_hits_ = 0;
+    size_t budget_;
+    mutable size_t resident_bytes_ = 0;
+    int next_handle_ = 1;
+    uint64_t next_content_ = 1;
+
+    // 新建一份内容并让 handle 引用它，不做换出
+    Content& insert_locked(int handle, std::shared_ptr<const ParsedChart> chart);
+    // 解除 handle 的引用，内容不再被引用时删除
+    void release_locked(int handle);
+    /* 把除 keep 以外最久未用的内容换出，直到常驻占用不超过预算
+     * 调用时持有 lock；写回与压缩期间释放锁，返回时重新持有，此前取得的 Content 引用不再可用
+     */
+    void evict(uint64_t keep, std::unique_lock<std::mutex>& lock) const;
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+/* 谱面解析与合并的核心逻辑
+ * 不依赖 Emscripten，WebAssembly 导出层（json_parser.cpp）和本地命令行（cli.cpp）共用。
+ */
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "../include/nlohmann/json.hpp"
+
+using json = nlohmann::json;
+
+struct JudgeLineStats {
+    int event_count;  // 该判定线的事件总数
+    int special_event_count;    // 该判定线的特殊事件总数
+    int note_count;   // 该判定线的音符总数
+};
+
+struct TimeSignature {
+    int measure;
+    int numerator;
+    int denominator;
+};
+
+struct JudgeLineConfig {
+    TimeSignature startTime;
+    TimeSignature endTime;
+    bool copyEvents;
+    bool copyNotes;
+};
+
+struct ParseResult {
+    // std::string raw_json;
+    // 我去，直接传输一个 40MB 的源文件吗，小心内存爆炸
+
+    int bpm_count;
+    double min_bpm;
+    double max_bpm;
+    int rpe_version;
+    std::string charter;
+    std::string composer;
+    std::string id;
+    std::string level;
+    std::string name;
+
+    int judge_line_count;
+    std::vector<JudgeLineStats> judge_line_stats;
+
+    int error_code;
+};
+
+// PEZ 解包的错误码，与前端的错误提示表对应
+enum PezError {
+    PEZ_OK = 0,
+    PEZ_INIT_FAILED = -3,       // ZIP 读取器初始化失败
+    PEZ_CHART_NOT_FOUND = -4,   // 包内没有谱面 JSON
+    PEZ_EXTRACT_FAILED = -5,    // 解压失败或内存不足
+    PEZ_WRITE_FAILED = -6,      // 打包新的 PEZ 失败
+};
+
+// 统计谱面信息（chart_parser.cpp）
+ParseResult parse_single_json(const char* json_str, size_t json_len);
+std::string result_to_json(const ParseResult& res);
+json result_to_object(const ParseResult& res);
+
+/* 从 PEZ 中解出谱面 JSON（pez.cpp）
+ * 成功时返回 malloc 分配、以 '\0' 结尾的缓冲区，调用者负责 free；
+ * 失败时返回 nullptr，错误码写入 error_code。
+ */
+char* extract_pez_chart(const unsigned char* pez_data, size_t data_size,
+                        size_t* out_len, int* error_code);
+
+struct PezChartEntry {
+    std::string name;
+    uint64_t size;   // 解压后的字节数
+};
+
+struct PezChartList {
+    int error_code;
+    std::string manifest_chart;               // info.txt / info.yml 中 Chart 字段的值，可能为空
+    std::string chart;                        // 实际会被载入的条目
+    std::vector<PezChartEntry> candidates;    // 包内所有以 .json 结尾的条目
+};
+
+/* 列出 PEZ 中可能的谱面文件（pez.cpp）
+ * 只读中央目录和说明文件，不解压谱面本身。
+ */
+PezChartList list_pez_charts(const unsigned char* pez_data, size_t data_size);
+
+class ChartCache;
+class OutputBuffer;
+
+/* 把合并后的谱面打包成 PEZ（pez.cpp）
+ * base_pez 中除谱面以外的条目（音乐、曲绘、说明文件等）直接复制压缩后的数据，不解压也不重新压缩，
+ * 谱面条目换成 chart_json 并重新压缩，条目名与原来相同，说明文件无需改动。
+ * 新的 PEZ 写入 out，返回 PEZ_OK 或错误码。
+ */
+int write_merged_pez(const unsigned char* base_pez, size_t base_size,
+                     const char* chart_json, size_t chart_len, OutputBuffer& out);
+
+/* 按表单合并谱面（chart_merge.cpp）
+ * 卡片带有 chartJson 时就地解析；否则按卡片的 handle 使用 cache 中载入时登记的谱面。
+ * 各卡片的 chartJson 与各判定线分给至多 threads 个线程处理（0 表示按硬件线程数），结果与单线程相同；
+ * 同时解析的卡片谱面也不超过 threads 份，以限制内存占用。
+ */
+json merge_json(json form_json, const ChartCache* cache = nullptr, unsigned threads = 1);
+
+/* 同上，但不建出合并后的 json，直接序列化到 out（json_writer.h）
+ * indent < 0 时输出紧凑格式。表单缺少字段时写入错误信息并返回 false。
+ */
+bool merge_to_buffer(json form_json, const ChartCache* cache, int indent, OutputBuffer& out,
+                     unsigned threads = 1);
@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <numeric>
+
+#include "chart_index.h"
+#include "chart_snapshot.h"
+
+const char* const EVENT_TYPES[EVENT_TYPE_COUNT] = {
+    "alphaEvents", "moveXEvents", "moveYEvents", "rotateEvents", "speedEvents"
+};
+
+bool has_start_end_time(const json& obj) {
+    return obj.contains("startTime") && obj["startTime"].is_array()
+        && obj.contains("endTime") && obj["endTime"].is_array();
+}
+
+static int number_or_zero(const json& value) {
+    return value.is_number() ? value.get<int>() : 0;
+}
+
+TimeSignature parse_time_array(const json& arr) {
+    TimeSignature ts = {0, 0, 1};
+    if (arr.size() >= 3) {
+        ts.measure = number_or_zero(arr[0]);
+        ts.numerator = number_or_zero(arr[1]);
+        int denominator = number_or_zero(arr[2]);
+        ts.denominator = denominator > 0 ? denominator : 1;
+    }
+    return ts;
+}
+
+Beat to_beats(const TimeSignature& ts) {
+    return Beat::from_time(ts.measure, ts.numerator, ts.denominator);
+}
+
+void TimeRangeIndex::build(const std::vector<TimeSignature>& start_times,
+                           const std::vector<TimeSignature>& end_times) {
+    order_.clear();
+    start_.clear();
+    end_.clear();
+    end_prefix_max_.clear();
+    end_suffix_min_.clear();
+    identity_order_ = true;
+
+    std::vector<uint32_t> order(start_times.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::vector<Beat> start;
+    std::vector<Beat> end;
+    start.reserve(start_times.size());
+    end.reserve(end_times.size());
+    for (size_t i = 0; i < start_times.size(); ++i) {
+        start.push_back(to_beats(start_times[i]));
+        end.push_back(to_beats(end_times[i]));
+    }
+
+    // 谱面中的事件通常已经按时间排好，这种情况下不需要再排序
+    if (!std::is_sorted(start.begin(), start.end())) {
+        std::vector<uint32_t> perm(order.size());
+        std::iota(perm.begin(), perm.end(), 0);
+        std::stable_sort(perm.begin(), perm.end(),
+            [&start](uint32_t a, uint32_t b) { return start[a] < start[b]; });
+
+        order_.reserve(perm.size());
+        start_.reserve(perm.size());
+        end_.reserve(perm.size());
+        for (uint32_t k : perm) {
+            order_.push_back(order[k]);
+            start_.push_back(start[k]);
+            end_.push_back(end[k]);
+        }
+        identity_order_ = false;
+    } else {
+        order_ = std::move(order);
+        start_ = std::move(start);
+        end_ = std::move(end);
+    }
+
+    size_t n = end_.size();
+    end_prefix_max_.resize(n);
+    end_suffix_min_.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        end_prefix_max_[i] = i == 0 ? end_[i] : std::max(end_prefix_max_[i - 1], end_[i]);
+    }
+    for (size_t i = n; i-- > 0;) {
+        end_suffix_min_[i] = i + 1 == n ? end_[i] : std::min(end_suffix_min_[i + 1], end_[i]);
+    }
+}
+
+void TimeRangeIndex::select(const TimeWindow& window, std::vector<uint32_t>& out) const {
+    size_t first_out = out.size();
+
+    // 下界：此前的元素一定不满足开始条件
+    size_t lo;
+    if (window.truncate_start) {
+        lo = std::lower_bound(start_.begin(), start_.end(), window.start_beats) - start_.begin();
+    } else {
+        lo = std::lower_bound(end_prefix_max_.begin(), end_prefix_max_.end(), window.start_beats)
+            - end_prefix_max_.begin();
+    }
+
+    // 上界：此后的元素一定不满足结束条件
+    size_t hi;
+    if (window.truncate_end) {
+        hi = std::upper_bound(end_suffix_min_.begin(), end_suffix_min_.end(), window.end_beats)
+            - end_suffix_min_.begin();
+    } else {
+        hi = std::upper_bound(start_.begin(), start_.end(), window.end_beats) - start_.begin();
+    }
+
+    for (size_t k = lo; k < hi; ++k) {
+        bool pass_start = window.truncate_start ? (start_[k] >= window.start_beats)
+                                                : (end_[k] >= window.start_beats);
+        bool pass_end = window.truncate_end ? (end_[k] <= window.end_beats)
+                                            : (start_[k] <= window.end_beats);
+        if (pass_start && pass_end) {
+            out.push_back(order_[k]);
+        }
+    }
+
+    // 原数组无序时，恢复原来的相对顺序，保证输出与逐个扫描一致
+    if (!identity_order_) {
+        std::sort(out.begin() + first_out, out.end());
+    }
+}
+
+void TimeRangeIndex::save(SnapshotWriter& writer) const {
+    writer.put_vector(order_);
+    writer.put_vector(start_);
+    writer.put_vector(end_);
+    writer.put_vector(end_prefix_max_);
+    writer.put_vector(end_suffix_min_);
+    writer.put<uint8_t>(identity_order_ ? 1 : 0);
+}
+
+void TimeRangeIndex::load(SnapshotReader& reader) {
+    reader.get_vector(order_);
+    reader.get_vector(start_);
+    reader.get_vector(end_);
+    reader.get_vector(end_prefix_max_);
+    reader.get_vector(end_suffix_min_);
+    identity_order_ = reader.get<uint8_t>() != 0;
+
+    // 损坏的快照不能让 select 越界
+    size_t n = start_.size();
+    if (end_.size() != n || end_prefix_max_.size() != n || end_suffix_min_.size() != n ||
+        order_.size() != n) {
+        reader.fail();
+        return;
+    }
+    for (uint32_t k : order_) {
+        if (k >= n) {
+            reader.fail();
+            return;
+        }
+    }
+}
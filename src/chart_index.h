@@ -0,0 +1,64 @@
+#pragma once
+
+/* 谱面的时间索引
+ * 对每条判定线、每层、每种事件以及音符，按开始拍建立有序索引，
+ * 合并时用二分查找直接定位时间窗口，而不是逐个检查所有事件。
+ */
+
+#include <cstdint>
+#include <vector>
+
+#include "chart_core.h"
+#include "beat.h"
+
+class SnapshotWriter;
+class SnapshotReader;
+
+constexpr int EVENT_LAYER_COUNT = 4;   // 合并只处理前 4 层事件
+constexpr int EVENT_TYPE_COUNT = 5;
+extern const char* const EVENT_TYPES[EVENT_TYPE_COUNT];
+
+bool has_start_end_time(const json& obj);
+TimeSignature parse_time_array(const json& arr);
+Beat to_beats(const TimeSignature& ts);
+
+// 合并时的时间窗口与截断方式
+struct TimeWindow {
+    Beat start_beats;
+    Beat end_beats;
+    bool truncate_start;   // 头时间必须不早于开始时间，否则只要尾时间不早于开始时间
+    bool truncate_end;     // 尾时间必须不晚于结束时间，否则只要头时间不晚于结束时间
+};
+
+class TimeRangeIndex {
+public:
+    // 第 i 个元素的开始/结束时间分别为 start_times[i] / end_times[i]
+    void build(const std::vector<TimeSignature>& start_times,
+               const std::vector<TimeSignature>& end_times);
+
+    /* 把落在窗口内的元素下标（按原顺序）追加到 out
+     * 先用二分查找把候选范围缩小到一段连续区间，再在区间内逐个确认，
+     * 对于事件互不重叠的常规谱面，区间内的元素全部命中。
+     */
+    void select(const TimeWindow& window, std::vector<uint32_t>& out) const;
+
+    size_t size() const { return start_.size(); }
+    // 索引占用的字节数
+    size_t memory_size() const {
+        return order_.capacity() * sizeof(uint32_t) +
+            (start_.capacity() + end_.capacity() + end_prefix_max_.capacity() + end_suffix_min_.capacity()) *
+            sizeof(Beat);
+    }
+
+    // 按原样写出/读回，读回后不必重新 build（chart_snapshot.h）
+    void save(SnapshotWriter& writer) const;
+    void load(SnapshotReader& reader);
+
+private:
+    std::vector<uint32_t> order_;          // 排序后第 k 个元素在原数组中的下标
+    std::vector<Beat> start_;              // 按开始拍升序
+    std::vector<Beat> end_;                // 与 start_ 对应的结束拍
+    std::vector<Beat> end_prefix_max_;     // end_ 的前缀最大值，用于“尾时间不早于开始时间”
+    std::vector<Beat> end_suffix_min_;     // end_ 的后缀最小值，用于“尾时间不晚于结束时间”
+    bool identity_order_ = true;           // 原数组本来就有序时，选出的下标天然保持原顺序
+};
@@ -0,0 +1,481 @@
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "chart_core.h"
+#include "chart_index.h"
+#include "chart_cache.h"
+#include "json_writer.h"
+#include "parallel.h"
+#include "perf.h"
+
+// 合并结果中的一段：某个谱面某组事件或音符中被选中的行（按原顺序）
+struct MergeSegment {
+    const ItemColumns* source;
+    std::vector<uint32_t> rows;
+};
+
+struct MergedLine {
+    const json* frame;   // 基准谱面对应判定线的 frame
+    std::vector<MergeSegment> events[EVENT_LAYER_COUNT][EVENT_TYPE_COUNT];
+    std::vector<MergeSegment> notes;
+};
+
+/* 合并方案：只记录每条判定线从哪些谱面选中了哪些行，
+ * 之后再决定建成 json 还是直接流式写出，不必先复制一遍事件。
+ */
+struct MergePlan {
+    std::vector<std::shared_ptr<const ParsedChart>> charts;   // 保证选中的行在输出前有效
+    const ParsedChart* base = nullptr;
+    std::vector<MergedLine> lines;
+};
+
+static json form_error() {
+    return {{"error", -2}, {"message", "Missing required fields in form"}};
+}
+
+static bool has_inline_chart(const json& card) {
+    return card.contains("chartJson") && card["chartJson"].is_string();
+}
+
+// 卡片谱面在缓存中的句柄（载入时登记，网页与命令行都写在卡片的 handle 中）
+static bool card_handle(const json& card, int& handle) {
+    if (!card.contains("handle") || !card["handle"].is_number()) return false;
+    handle = card["handle"].get<int>();
+    return true;
+}
+
+static bool has_card_chart(const json& card, const ChartCache* cache) {
+    if (has_inline_chart(card)) return true;
+    int handle = 0;
+    return cache && card_handle(card, handle) && cache->contains(handle);
+}
+
+// 取得卡片对应的谱面：表单中带 chartJson 的就地解析，否则使用载入时缓存的谱面
+static std::shared_ptr<const ParsedChart> resolve_card_chart(json& card, const ChartCache* cache) {
+    if (has_inline_chart(card)) {
+        std::string& chart_str = card["chartJson"].get_ref<std::string&>();
+        PerfScope scope(PerfPhase::ChartParse, chart_str.size());
+        // 谱面格式错误时按空谱面处理，而不是在 -fno-exceptions 下直接 abort
+        auto parsed = std::make_shared<ParsedChart>();
+        build_chart_store(chart_str.data(), chart_str.size(), *parsed);
+        // 源字符串已经用不到了，尽早释放
+        std::string().swap(chart_str);
+        return parsed;
+    }
+    int handle = 0;
+    if (cache && card_handle(card, handle)) {
+        return cache->find(handle);
+    }
+    return nullptr;
+}
+
+/* 按批并行取得卡片谱面：每批至多 limit 张，由 parallel_for 同时解析
+ * 选完一张卡片就释放它的谱面（被选中的除外），同时存在的未选谱面不超过一批，内存占用有上限。
+ * 第一批带上基准谱面所在的卡片，基准谱面与其他卡片同时解析。
+ */
+class CardChartLoader {
+public:
+    CardChartLoader(json& cards, const ChartCache* cache, unsigned limit, size_t base_pos)
+        : cards_(cards), cache_(cache), limit_(std::max(1u, limit)), base_pos_(base_pos),
+          charts_(cards.size()), loaded_(cards.size(), false) {
+        std::vector<size_t> batch;
+        if (base_pos_ < cards_.size()) batch.push_back(base_pos_);
+        load_batch(batch);
+    }
+
+    // 取走第 pos 张卡片的谱面，尚未解析时先解析下一批
+    std::shared_ptr<const ParsedChart> take(size_t pos) {
+        if (!loaded_[pos]) load_batch({});
+        return std::move(charts_[pos]);
+    }
+
+private:
+    json& cards_;
+    const ChartCache* cache_;
+    unsigned limit_;
+    size_t base_pos_;
+    std::vector<std::shared_ptr<const ParsedChart>> charts_;
+    std::vector<bool> loaded_;
+    size_t next_ = 0;   // 下一批从这张卡片开始
+
+    void load_batch(std::vector<size_t> batch) {
+        while (next_ < cards_.size() && batch.size() < limit_) {
+            if (next_ != base_pos_) batch.push_back(next_);
+            next_++;
+        }
+        for (size_t pos : batch) loaded_[pos] = true;
+        // 各卡片的 json 互不相干，resolve_card_chart 只改动自己那张卡片
+        parallel_for(batch.size(), limit_, [&](size_t k) {
+            charts_[batch[k]] = resolve_card_chart(cards_[batch[k]], cache_);
+        });
+    }
+};
+
+static bool plan_merge(json& form_json, const ChartCache* cache, MergePlan& plan, unsigned threads) {
+    if (!form_json.contains("firstCardId") || !form_json["firstCardId"].is_number() ||
+        !form_json.contains("truncateStart") || !form_json["truncateStart"].is_boolean() ||
+        !form_json.contains("truncateEnd") || !form_json["truncateEnd"].is_boolean() ||
+        !form_json.contains("cards") || !form_json["cards"].is_array()) {
+        return false;
+    }
+
+    int first_card_id = form_json["firstCardId"].get<int>();
+    bool truncate_start = form_json["truncateStart"].get<bool>();
+    bool truncate_end = form_json["truncateEnd"].get<bool>();
+    auto& cards_array = form_json["cards"];
+
+    // 基准谱面只解析一次，后面遍历到这张卡片时直接复用
+    size_t base_pos = cards_array.size();
+    for (size_t pos = 0; pos < cards_array.size(); ++pos) {
+        auto& card = cards_array[pos];
+        if (card.contains("id") && card["id"].is_number() && 
+            card["id"].get<int>() == first_card_id &&
+            has_card_chart(card, cache)) {
+            base_pos = pos;
+            break;
+        }
+    }
+    CardChartLoader loader(cards_array, cache, threads, base_pos);
+    std::shared_ptr<const ParsedChart> base =
+        base_pos < cards_array.size() ? loader.take(base_pos) : nullptr;
+    static const ParsedChart empty_chart;
+    const ParsedChart& base_chart = base ? *base : empty_chart;
+    plan.base = &base_chart;
+    if (base) plan.charts.push_back(base);
+
+    PerfScope frame_scope(PerfPhase::FrameBuild);
+    int judge_line_count = 0;
+    if (base_chart.has_judge_line_list) {
+        judge_line_count = base_chart.lines.size();
+        plan.lines.resize(judge_line_count);
+        for (int i = 0; i < judge_line_count; ++i) {
+            plan.lines[i].frame = &base_chart.lines[i].frame;
+        }
+    }
+    frame_scope.stop();
+
+    for (size_t pos = 0; pos < cards_array.size(); ++pos) {
+        auto& card = cards_array[pos];
+        PerfScope config_scope(PerfPhase::FrameBuild);
+        std::vector<JudgeLineConfig> judge_line_configs(judge_line_count);
+
+        TimeSignature default_start = {0, 0, 1};
+        TimeSignature default_end = {0, 0, 1};
+        bool default_copy_events = false;
+        bool default_copy_notes = false;
+
+        if (card.contains("timeControls") && card["timeControls"].is_object()) {
+            auto& time_controls = card["timeControls"];
+            // 解析通用复选框参数
+            if (time_controls.contains("checkboxes") && time_controls["checkboxes"].is_array() && 
+                time_controls["checkboxes"].size() >= 2) {
+                default_copy_events = time_controls["checkboxes"][0].get<bool>();
+                default_copy_notes = time_controls["checkboxes"][1].get<bool>();
+            }
+            // 解析通用时间参数
+            if (time_controls.contains("inputs") && time_controls["inputs"].is_array() && 
+                time_controls["inputs"].size() >= 6) {
+                auto& inputs = time_controls["inputs"];
+                default_start = {
+                    inputs[0].get<int>(),
+                    inputs[1].get<int>(),
+                    inputs[2].get<int>()
+                };
+                default_end = {
+                    inputs[3].get<int>(),
+                    inputs[4].get<int>(),
+                    inputs[5].get<int>()
+                };
+            }
+        }
+        std::vector<json> independent_lines;
+        if (card.contains("independentJudgeLines") && card["independentJudgeLines"].is_array()) {
+            independent_lines = card["independentJudgeLines"].get<std::vector<json>>();
+        }
+
+        for (int i = 0; i < judge_line_count; ++i) {
+            // 默认使用通用配置
+            JudgeLineConfig config;
+            config.startTime = default_start;
+            config.endTime = default_end;
+            config.copyEvents = default_copy_events;
+            config.copyNotes = default_copy_notes;
+
+            // 查找当前判定线是否有独立配置
+            auto it = std::find_if(independent_lines.begin(), independent_lines.end(),
+                [i](const json& line) {
+                    return line.contains("id") && line["id"].is_number() && line["id"].get<int>() == i;
+                });
+
+            if (it != independent_lines.end()) {
+                // 存在独立配置，处理参数覆盖
+                auto& independent_config = *it;
+                if (independent_config.contains("timeControls") && independent_config["timeControls"].is_object()) {
+                    auto& ind_time_controls = independent_config["timeControls"];
+                    // 处理复选框参数
+                    if (ind_time_controls.contains("checkboxes") && ind_time_controls["checkboxes"].is_array() &&
+                        ind_time_controls["checkboxes"].size() >= 2) {
+                        config.copyEvents = ind_time_controls["checkboxes"][0].get<bool>();
+                        config.copyNotes = ind_time_controls["checkboxes"][1].get<bool>();
+                    }
+                    // 处理时间参数（-1 表示使用通用配置对应值）
+                    if (ind_time_controls.contains("inputs") && ind_time_controls["inputs"].is_array() &&
+                        ind_time_controls["inputs"].size() >= 6) {
+                        auto& ind_inputs = ind_time_controls["inputs"];
+                        // 处理开始时间
+                        config.startTime.measure = (ind_inputs[0].get<int>() == -1) ? default_start.measure : ind_inputs[0].get<int>();
+                        config.startTime.numerator = (ind_inputs[1].get<int>() == -1) ? default_start.numerator : ind_inputs[1].get<int>();
+                        config.startTime.denominator = (ind_inputs[2].get<int>() == -1) ? default_start.denominator : ind_inputs[2].get<int>();
+                        // 处理结束时间
+                        config.endTime.measure = (ind_inputs[3].get<int>() == -1) ? default_end.measure : ind_inputs[3].get<int>();
+                        config.endTime.numerator = (ind_inputs[4].get<int>() == -1) ? default_end.numerator : ind_inputs[4].get<int>();
+                        config.endTime.denominator = (ind_inputs[5].get<int>() == -1) ? default_end.denominator : ind_inputs[5].get<int>();
+                    }
+                }
+            }
+
+            // 存入配置向量
+            judge_line_configs[i] = config;
+        }
+
+        config_scope.stop();
+
+        std::shared_ptr<const ParsedChart> card_chart =
+            pos == base_pos ? std::move(base) : loader.take(pos);
+        if (card_chart && card_chart->has_judge_line_list) {
+            PerfScope selection_scope(PerfPhase::Selection);
+            const std::vector<JudgeLineStore>& lines = card_chart->lines;
+            size_t line_count = std::min(lines.size(), static_cast<size_t>(judge_line_count));
+            bool used = false;
+
+            for (size_t idx = 0; idx < line_count; ++idx) {
+                const JudgeLineConfig& config = judge_line_configs[idx];
+                const JudgeLineStore& line = lines[idx];
+                MergedLine& merged_line = plan.lines[idx];
+                TimeWindow window = {
+                    to_beats(config.startTime),
+                    to_beats(config.endTime),
+                    truncate_start,
+                    truncate_end
+                };
+                if (window.start_beats > window.end_beats) continue;
+
+                if (config.copyEvents) {
+                    // 复制事件，只处理前 4 层
+                    for (int layer_idx = 0; layer_idx < EVENT_LAYER_COUNT; ++layer_idx) {
+                        for (int type = 0; type < EVENT_TYPE_COUNT; ++type) {
+                            const ItemColumns& source = line.events[layer_idx][type];
+                            if (source.size() == 0) continue;
+
+                            MergeSegment segment = {&source, {}};
+                            source.index().select(window, segment.rows);
+                            if (segment.rows.empty()) continue;
+                            merged_line.events[layer_idx][type].push_back(std::move(segment));
+                            used = true;
+                        }
+                    }
+                }
+                if (config.copyNotes && line.notes.size() > 0) {
+                    // 复制音符到合并结果的对应判定线
+                    MergeSegment segment = {&line.notes, {}};
+                    line.notes.index().select(window, segment.rows);
+                    if (!segment.rows.empty()) {
+                        merged_line.notes.push_back(std::move(segment));
+                        used = true;
+                    }
+                }
+            }
+            if (used && pos != base_pos) {
+                plan.charts.push_back(std::move(card_chart));
+            }
+        }
+    }
+
+    return true;
+}
+
+static json build_line_json(const MergedLine& line) {
+    json line_frame = *line.frame;
+
+    line_frame["eventLayers"] = json::array();
+    for (int layer_idx = 0; layer_idx < EVENT_LAYER_COUNT; ++layer_idx) { // 四层事件
+        json layer_events = json::object();
+        for (int type = 0; type < EVENT_TYPE_COUNT; ++type) {
+            json& target = layer_events[EVENT_TYPES[type]] = json::array();
+            for (const MergeSegment& segment : line.events[layer_idx][type]) {
+                for (uint32_t k : segment.rows) {
+                    target.push_back(segment.source->to_json(k));
+                }
+            }
+        }
+        line_frame["eventLayers"].push_back(std::move(layer_events));
+    }
+
+    json& notes = line_frame["notes"] = json::array();
+    for (const MergeSegment& segment : line.notes) {
+        for (uint32_t k : segment.rows) {
+            notes.push_back(segment.source->to_json(k));
+        }
+    }
+    return line_frame;
+}
+
+json merge_json(json form_json, const ChartCache* cache, unsigned threads) {
+    MergePlan plan;
+    if (!plan_merge(form_json, cache, plan, resolve_thread_count(threads))) {
+        return form_error();
+    }
+
+    // 各判定线互不相关，可以分给多个线程构建，再按原顺序放进结果
+    PerfScope scope(PerfPhase::Serialization);
+    std::vector<json> lines(plan.lines.size());
+    parallel_for(lines.size(), resolve_thread_count(threads), [&](size_t idx) {
+        lines[idx] = build_line_json(plan.lines[idx]);
+    });
+
+    json merged = plan.base->frame;
+    json& merged_judge_lines = merged["judgeLineList"] = json::array();
+    for (json& line : lines) {
+        merged_judge_lines.push_back(std::move(line));
+    }
+    return merged;
+}
+
+static void write_segments(JsonWriter& writer, const std::vector<MergeSegment>& segments) {
+    writer.begin_array();
+    for (const MergeSegment& segment : segments) {
+        for (uint32_t k : segment.rows) {
+            segment.source->write(k, writer);
+        }
+    }
+    writer.end_array();
+}
+
+/* 按键的字典序写出 frame 中的字段，并把 extra_keys（已排序，且不在 frame 中）插到相应位置
+ * write_extra(i) 负责写出第 i 个额外字段的值。
+ */
+template <typename F>
+static void write_frame(JsonWriter& writer, const json& frame,
+                        const char* const* extra_keys, int extra_count, F&& write_extra) {
+    int next = 0;
+    writer.begin_object();
+    for (auto it = frame.begin(); it != frame.end(); ++it) {
+        while (next < extra_count && it.key().compare(extra_keys[next]) > 0) {
+            writer.key(extra_keys[next]);
+            write_extra(next++);
+        }
+        writer.key(it.key());
+        writer.value(it.value());
+    }
+    while (next < extra_count) {
+        writer.key(extra_keys[next]);
+        write_extra(next++);
+    }
+    writer.end_object();
+}
+
+static void write_line(JsonWriter& writer, const MergedLine& line) {
+    static const char* const line_keys[] = {"eventLayers", "notes"};
+    write_frame(writer, *line.frame, line_keys, 2, [&](int key) {
+        if (key == 1) {
+            write_segments(writer, line.notes);
+            return;
+        }
+        writer.begin_array();
+        for (int layer_idx = 0; layer_idx < EVENT_LAYER_COUNT; ++layer_idx) {
+            writer.begin_object();
+            for (int type = 0; type < EVENT_TYPE_COUNT; ++type) {
+                writer.key(EVENT_TYPES[type]);
+                write_segments(writer, line.events[layer_idx][type]);
+            }
+            writer.end_object();
+        }
+        writer.end_array();
+    });
+}
+
+// 并行写出时每段至少包含的事件与音符数，太小的谱面不值得拆分
+static const size_t MIN_ROWS_PER_TASK = 4096;
+
+static size_t line_rows(const MergedLine& line) {
+    size_t rows = 1;
+    for (const auto& layer : line.events) {
+        for (const auto& segments : layer) {
+            for (const MergeSegment& segment : segments) rows += segment.rows.size();
+        }
+    }
+    for (const MergeSegment& segment : line.notes) rows += segment.rows.size();
+    return rows;
+}
+
+/* 按行数把判定线切成大致均衡的若干连续区间，返回各区间的起点，最后一项为判定线数量
+ * 区间数取线程数的几倍，某条判定线特别大时其余线程仍有活可干。
+ */
+static std::vector<size_t> split_lines(const std::vector<MergedLine>& lines, unsigned threads) {
+    std::vector<size_t> rows(lines.size());
+    size_t total = 0;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        rows[i] = line_rows(lines[i]);
+        total += rows[i];
+    }
+    size_t target = std::max(total / (threads * 4), MIN_ROWS_PER_TASK);
+
+    std::vector<size_t> bounds = {0};
+    size_t acc = 0;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        acc += rows[i];
+        if (acc >= target && i + 1 < lines.size()) {
+            bounds.push_back(i + 1);
+            acc = 0;
+        }
+    }
+    bounds.push_back(lines.size());
+    return bounds;
+}
+
+// 判定线数组的内容：多线程时各段写进各自的缓冲区，再按顺序接起来，结果与单线程逐字节相同
+static void write_lines(JsonWriter& writer, const MergePlan& plan, int indent,
+                        unsigned threads, OutputBuffer& out) {
+    std::vector<size_t> bounds = threads > 1 ? split_lines(plan.lines, threads) : std::vector<size_t>();
+    if (bounds.size() <= 2) {
+        for (const MergedLine& line : plan.lines) write_line(writer, line);
+        return;
+    }
+
+    size_t tasks = bounds.size() - 1;
+    std::vector<OutputBuffer> parts(tasks);
+    parallel_for(tasks, threads, [&](size_t t) {
+        // 判定线位于根对象与 judgeLineList 数组之下，即第 2 层
+        JsonWriter part(parts[t], indent, 2, t > 0);
+        for (size_t i = bounds[t]; i < bounds[t + 1]; ++i) write_line(part, plan.lines[i]);
+    });
+    for (OutputBuffer& part : parts) {
+        if (part.failed()) out.mark_failed();
+        writer.append_fragment(part.data(), part.size());
+        part.clear();
+    }
+}
+
+bool merge_to_buffer(json form_json, const ChartCache* cache, int indent, OutputBuffer& out,
+                     unsigned threads) {
+    JsonWriter writer(out, indent);
+    MergePlan plan;
+    if (!plan_merge(form_json, cache, plan, resolve_thread_count(threads))) {
+        writer.value(form_error());
+        return false;
+    }
+    // 表单（以及其中已解析的 chartJson）不再需要，先释放再开始输出
+    form_json = json();
+
+    PerfScope scope(PerfPhase::Serialization);
+    size_t start_size = out.size();
+    static const char* const chart_keys[] = {"judgeLineList"};
+    write_frame(writer, plan.base->frame, chart_keys, 1, [&](int) {
+        writer.begin_array();
+        write_lines(writer, plan, indent, resolve_thread_count(threads), out);
+        writer.end_array();
+    });
+    scope.add_bytes(out.size() - start_size);
+    return !out.failed();
+}
@@ -0,0 +1,434 @@
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+
+#include "chart_core.h"
+#include "chart_cache.h"
+#include "json_insitu_parser.h"
+#include "json_push_parser.h"
+#include "perf.h"
+
+/* 统计用的 SAX 处理器
+ * 解析时逐个 token 回调，只维护一个很浅的上下文栈，
+ * 不会在内存里构建整棵 DOM 树（40MB 的谱面构建 DOM 要吃掉好几倍的内存）。
+ * 统计口径与原先基于 DOM 的遍历保持一致。
+ */
+class ChartStatsSax {
+public:
+    explicit ChartStatsSax(ParseResult& result) : result_(result) {}
+
+    bool null() { return scalar(); }
+    bool boolean(bool) { return scalar(); }
+    bool number_integer(json::number_integer_t val) { return number(static_cast<double>(val), static_cast<int>(val)); }
+    bool number_unsigned(json::number_unsigned_t val) { return number(static_cast<double>(val), static_cast<int>(val)); }
+    bool number_float(json::number_float_t val, std::string_view) { return number(val, static_cast<int>(val)); }
+    bool binary(json::binary_t&) { return scalar(); }
+
+    bool string(std::string_view val) {
+        if (skip_depth_ > 0) return true;
+        if (!stack_.empty() && stack_.back().node == Node::Meta) {
+            switch (stack_.back().field) {
+                case Field::Charter:  result_.charter = val; break;
+                case Field::Composer: result_.composer = val; break;
+                case Field::Id:       result_.id = val; break;
+                case Field::Level:    result_.level = val; break;
+                case Field::Name:     result_.name = val; break;
+                default: break;
+            }
+            return true;
+        }
+        return scalar();
+    }
+
+    bool start_object(std::size_t) { return start_container(false); }
+    bool start_array(std::size_t) { return start_container(true); }
+
+    bool end_object() { return end_container(); }
+    bool end_array() { return end_container(); }
+
+    bool key(std::string_view val) {
+        if (skip_depth_ > 0) return true;
+        Frame& top = stack_.back();
+        top.field = Field::None;
+        switch (top.node) {
+            case Node::Root:
+                if (val == "BPMList") top.field = Field::BpmList;
+                else if (val == "META") top.field = Field::Meta;
+                else if (val == "judgeLineList") top.field = Field::JudgeLineList;
+                break;
+            case Node::BpmItem:
+                if (val == "bpm") top.field = Field::Bpm;
+                break;
+            case Node::Meta:
+                if (val == "RPEVersion") top.field = Field::RPEVersion;
+                else if (val == "charter") top.field = Field::Charter;
+                else if (val == "composer") top.field = Field::Composer;
+                else if (val == "id") top.field = Field::Id;
+                else if (val == "level") top.field = Field::Level;
+                else if (val == "name") top.field = Field::Name;
+                break;
+            case Node::JudgeLine:
+                if (val == "eventLayers") top.field = Field::EventLayers;
+                else if (val == "extended") top.field = Field::Extended;
+                else if (val == "notes") top.field = Field::Notes;
+                break;
+            case Node::EventLayer:
+                if (val == "alphaEvents" || val == "moveXEvents" || val == "moveYEvents" ||
+                    val == "rotateEvents" || val == "speedEvents") {
+                    top.field = Field::EventArray;
+                }
+                break;
+            case Node::Extended:
+                // extended 下的数组不限制键名
+                top.field = Field::ExtendedArray;
+                break;
+            case Node::Item:
+                if (val == "startTime") top.field = Field::StartTime;
+                else if (val == "endTime") top.field = Field::EndTime;
+                break;
+            default:
+                break;
+        }
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const json::exception&) {
+        return false;
+    }
+
+private:
+    enum class Node {
+        Root, BpmList, BpmItem, Meta,
+        JudgeLineList, JudgeLine, EventLayers, EventLayer, Extended,
+        EventArray, ExtendedArray, NoteArray, Item
+    };
+    enum class Field {
+        None, BpmList, Meta, JudgeLineList,
+        EventLayers, Extended, Notes, EventArray, ExtendedArray,
+        StartTime, EndTime, Bpm,
+        RPEVersion, Charter, Composer, Id, Level, Name
+    };
+    enum class Counter { Event, SpecialEvent, Note };
+
+    struct Frame {
+        Node node;
+        Field field;        // 对象中当前键对应的字段
+        Counter counter;    // Item 结束时计入哪一类统计
+        bool has_start;     // Item 是否有数组类型的 startTime
+        bool has_end;       // Item 是否有数组类型的 endTime
+    };
+
+    ParseResult& result_;
+    std::vector<Frame> stack_;
+    int skip_depth_ = 0;   // 处于不关心的子树中时只记录深度
+    bool top_level_seen_ = false;
+    bool has_bpm_ = false;
+
+    // 数组中的每个元素（无论类型）在进入时先走一遍计数
+    void begin_element() {
+        if (stack_.empty()) return;
+        Frame& top = stack_.back();
+        if (top.node == Node::BpmList) {
+            result_.bpm_count++;
+        } else if (top.node == Node::JudgeLineList) {
+            result_.judge_line_count++;
+            result_.judge_line_stats.push_back({0, 0, 0});
+        }
+    }
+
+    void set_time_flag(bool is_array) {
+        Frame& top = stack_.back();
+        if (top.field == Field::StartTime) top.has_start = is_array;
+        else if (top.field == Field::EndTime) top.has_end = is_array;
+    }
+
+    bool scalar() {
+        if (skip_depth_ > 0) return true;
+        begin_element();
+        if (!stack_.empty() && stack_.back().node == Node::Item) {
+            set_time_flag(false);
+        }
+        return true;
+    }
+
+    bool number(double val, int int_val) {
+        if (skip_depth_ > 0) return true;
+        begin_element();
+        if (stack_.empty()) return true;
+        Frame& top = stack_.back();
+        if (top.node == Node::BpmItem && top.field == Field::Bpm) {
+            if (!has_bpm_) {
+                result_.min_bpm = result_.max_bpm = val;
+                has_bpm_ = true;
+            } else {
+                result_.min_bpm = std::min(result_.min_bpm, val);
+                result_.max_bpm = std::max(result_.max_bpm, val);
+            }
+        } else if (top.node == Node::Meta && top.field == Field::RPEVersion) {
+            result_.rpe_version = int_val;
+        } else if (top.node == Node::Item) {
+            set_time_flag(false);
+        }
+        return true;
+    }
+
+    bool start_container(bool is_array) {
+        if (skip_depth_ > 0) {
+            skip_depth_++;
+            return true;
+        }
+        if (stack_.empty()) {
+            // 顶层必须是对象才有意义
+            if (top_level_seen_ || is_array) {
+                skip_depth_++;
+            } else {
+                stack_.push_back({Node::Root, Field::None, Counter::Event, false, false});
+            }
+            top_level_seen_ = true;
+            return true;
+        }
+
+        begin_element();
+        Frame& top = stack_.back();
+        Node child = Node::Root;
+        bool known = false;
+        Counter counter = Counter::Event;
+
+        switch (top.node) {
+            case Node::Root:
+                if (top.field == Field::BpmList && is_array) { child = Node::BpmList; known = true; }
+                else if (top.field == Field::Meta && !is_array) { child = Node::Meta; known = true; }
+                else if (top.field == Field::JudgeLineList && is_array) { child = Node::JudgeLineList; known = true; }
+                break;
+            case Node::BpmList:
+                if (!is_array) { child = Node::BpmItem; known = true; }
+                break;
+            case Node::JudgeLineList:
+                if (!is_array) { child = Node::JudgeLine; known = true; }
+                break;
+            case Node::JudgeLine:
+                if (top.field == Field::EventLayers && is_array) { child = Node::EventLayers; known = true; }
+                else if (top.field == Field::Extended && !is_array) { child = Node::Extended; known = true; }
+                else if (top.field == Field::Notes && is_array) { child = Node::NoteArray; known = true; }
+                break;
+            case Node::EventLayers:
+                if (!is_array) { child = Node::EventLayer; known = true; }
+                break;
+            case Node::EventLayer:
+                if (top.field == Field::EventArray && is_array) { child = Node::EventArray; known = true; }
+                break;
+            case Node::Extended:
+                if (top.field == Field::ExtendedArray && is_array) { child = Node::ExtendedArray; known = true; }
+                break;
+            case Node::EventArray:
+            case Node::ExtendedArray:
+            case Node::NoteArray:
+                if (!is_array) {
+                    child = Node::Item;
+                    known = true;
+                    counter = top.node == Node::EventArray ? Counter::Event
+                            : top.node == Node::ExtendedArray ? Counter::SpecialEvent
+                            : Counter::Note;
+                }
+                break;
+            case Node::Item:
+                set_time_flag(is_array);
+                break;
+            default:
+                break;
+        }
+
+        if (known) {
+            stack_.push_back({child, Field::None, counter, false, false});
+        } else {
+            skip_depth_++;
+        }
+        return true;
+    }
+
+    bool end_container() {
+        if (skip_depth_ > 0) {
+            skip_depth_--;
+            return true;
+        }
+        const Frame& top = stack_.back();
+        if (top.node == Node::Item && top.has_start && top.has_end) {
+            JudgeLineStats& stats = result_.judge_line_stats.back();
+            switch (top.counter) {
+                case Counter::Event:        stats.event_count++; break;
+                case Counter::SpecialEvent: stats.special_event_count++; break;
+                case Counter::Note:         stats.note_count++; break;
+            }
+        }
+        stack_.pop_back();
+        return true;
+    }
+};
+
+/* 把同一串 SAX 事件同时交给两个处理器
+ * 载入卡片时用它一边统计、一边构建紧凑存储，整份谱面只扫描一遍。
+ */
+template <typename First, typename Second>
+class SaxTee {
+public:
+    SaxTee(First& first, Second& second) : first_(first), second_(second) {}
+
+    bool null() { return first_.null() && second_.null(); }
+    bool boolean(bool val) { return first_.boolean(val) && second_.boolean(val); }
+    bool number_integer(json::number_integer_t val) { return first_.number_integer(val) && second_.number_integer(val); }
+    bool number_unsigned(json::number_unsigned_t val) { return first_.number_unsigned(val) && second_.number_unsigned(val); }
+    bool number_float(json::number_float_t val, std::string_view s) { return first_.number_float(val, s) && second_.number_float(val, s); }
+    bool string(std::string_view val) { return first_.string(val) && second_.string(val); }
+    bool binary(json::binary_t& val) { return first_.binary(val) && second_.binary(val); }
+    bool start_object(std::size_t n) { return first_.start_object(n) && second_.start_object(n); }
+    bool key(std::string_view val) { return first_.key(val) && second_.key(val); }
+    bool end_object() { return first_.end_object() && second_.end_object(); }
+    bool start_array(std::size_t n) { return first_.start_array(n) && second_.start_array(n); }
+    bool end_array() { return first_.end_array() && second_.end_array(); }
+    bool parse_error(std::size_t pos, const std::string& token, const json::exception& ex) {
+        first_.parse_error(pos, token, ex);
+        return second_.parse_error(pos, token, ex);
+    }
+
+private:
+    First& first_;
+    Second& second_;
+};
+
+static ParseResult empty_result(int error_code) {
+    return {
+        0, 0.0, 0.0, 0, "", "", "", "", "",
+        0, {},
+        error_code};
+}
+
+ParseResult parse_single_json(const char* json_str, size_t json_len) {
+    ParseResult result = empty_result(-1);
+    if (!json_str || json_len == 0) {
+        result.error_code = -2;
+        return result;
+    }
+
+    // 流式统计，不再 json::parse 出完整的 DOM；就地解析失败时丢弃统计到一半的内容，以 nlohmann 再解析一遍
+    PerfScope scope(PerfPhase::ChartParse, json_len);
+    for (JsonBackend backend : JSON_BACKENDS) {
+        result = empty_result(-1);
+        ChartStatsSax sax(result);
+        if (sax_parse_json(backend, json_str, json_str + json_len, sax)) {
+            result.error_code = 0;
+            return result;
+        }
+    }
+    // 格式错误
+    result = empty_result(-1);
+    return result;
+}
+
+std::shared_ptr<ParsedChart> parse_chart(const char* json_str, size_t json_len, ParseResult& stats) {
+    stats = empty_result(-1);
+    if (!json_str || json_len == 0) {
+        stats.error_code = -2;
+        return nullptr;
+    }
+
+    PerfScope scope(PerfPhase::ChartParse, json_len);
+    for (JsonBackend backend : JSON_BACKENDS) {
+        if (auto parsed = parse_chart_with(backend, json_str, json_len, stats)) return parsed;
+    }
+    return nullptr;
+}
+
+std::shared_ptr<ParsedChart> parse_chart_with(JsonBackend backend, const char* json_str, size_t json_len,
+                                              ParseResult& stats) {
+    stats = empty_result(-1);
+    if (!json_str || json_len == 0) {
+        stats.error_code = -2;
+        return nullptr;
+    }
+
+    auto parsed = std::make_shared<ParsedChart>();
+    ChartStatsSax stats_sax(stats);
+    ChartStoreBuilder store_sax(*parsed);
+    SaxTee<ChartStatsSax, ChartStoreBuilder> tee(stats_sax, store_sax);
+    if (sax_parse_json(backend, json_str, json_str + json_len, tee)) {
+        stats.error_code = 0;
+        return parsed;
+    }
+    stats = empty_result(-1);
+    return nullptr;
+}
+
+struct ChartStreamParser::Impl {
+    ParseResult& stats;
+    std::shared_ptr<ParsedChart> chart = std::make_shared<ParsedChart>();
+    ChartStatsSax stats_sax{stats};
+    ChartStoreBuilder store_sax{*chart};
+    SaxTee<ChartStatsSax, ChartStoreBuilder> tee{stats_sax, store_sax};
+    JsonPushParser<SaxTee<ChartStatsSax, ChartStoreBuilder>> parser{tee};
+    size_t total = 0;
+
+    explicit Impl(ParseResult& s) : stats(s) {}
+};
+
+ChartStreamParser::ChartStreamParser(ParseResult& stats) {
+    stats = empty_result(-1);
+    impl_.reset(new Impl(stats));
+}
+
+ChartStreamParser::~ChartStreamParser() = default;
+
+bool ChartStreamParser::feed(const char* data, size_t len) {
+    impl_->total += len;
+    return impl_->parser.feed(data, len);
+}
+
+std::shared_ptr<ParsedChart> ChartStreamParser::finish() {
+    ParseResult& stats = impl_->stats;
+    if (impl_->total == 0) {
+        stats = empty_result(-2);
+        return nullptr;
+    }
+    if (!impl_->parser.finish()) {
+        stats = empty_result(-1);
+        return nullptr;
+    }
+    stats.error_code = 0;
+    return std::move(impl_->chart);
+}
+
+std::string result_to_json(const ParseResult& res) {
+    return result_to_object(res).dump();
+}
+
+json result_to_object(const ParseResult& res) {
+    json j;
+    // j["raw_json"] = res.raw_json;
+
+    j["bpm_count"] = res.bpm_count;
+    j["min_bpm"] = res.min_bpm;
+    j["max_bpm"] = res.max_bpm;
+    j["rpe_version"] = res.rpe_version;
+    j["charter"] = res.charter;
+    j["composer"] = res.composer;
+    j["id"] = res.id;
+    j["level"] = res.level;
+    j["name"] = res.name;
+
+    j["judge_line_count"] = res.judge_line_count;
+    // 转换每个判定线的统计数据为 JSON 数组
+    json judge_line_stats_json = json::array();
+    for (const auto& stats : res.judge_line_stats) {
+        judge_line_stats_json.push_back({
+            {"event_count", stats.event_count},
+            {"special_event_count", stats.special_event_count},
+            {"note_count", stats.note_count}
+        });
+    }
+    j["judge_line_stats"] = judge_line_stats_json;
+
+    j["error"] = res.error_code;
+
+    return j;
+}
+
@@ -0,0 +1,169 @@
+#include "chart_snapshot.h"
+#include "chart_store.h"
+
+static const char SNAPSHOT_MAGIC[4] = {'P', 'C', 'S', 'N'};
+// 写出与读取的平台字节序不同时，按原样 memcpy 的数值都会错，直接拒绝
+static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+void SnapshotWriter::put_string(const std::string& s) {
+    put<uint64_t>(s.size());
+    out_.append(s.data(), s.size());
+}
+
+void SnapshotWriter::put_object(const json& value) {
+    std::vector<uint8_t> packed;
+    json::to_msgpack(value, packed);
+    put_vector(packed);
+}
+
+// 严格的 UTF-8 校验（拒绝过长编码、代理项与超出 U+10FFFF 的码点），与 nlohmann 序列化时的要求一致
+static bool valid_utf8(const std::string& s) {
+    size_t i = 0;
+    while (i < s.size()) {
+        unsigned char c = static_cast<unsigned char>(s[i++]);
+        if (c < 0x80) continue;
+        int remaining;
+        unsigned char lo = 0x80, hi = 0xBF;
+        if (c >= 0xC2 && c <= 0xDF) {
+            remaining = 1;
+        } else if (c >= 0xE0 && c <= 0xEF) {
+            remaining = 2;
+            if (c == 0xE0) lo = 0xA0;
+            if (c == 0xED) hi = 0x9F;
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            remaining = 3;
+            if (c == 0xF0) lo = 0x90;
+            if (c == 0xF4) hi = 0x8F;
+        } else {
+            return false;
+        }
+        for (int k = 0; k < remaining; ++k, lo = 0x80, hi = 0xBF) {
+            if (i >= s.size()) return false;
+            unsigned char b = static_cast<unsigned char>(s[i++]);
+            if (b < lo || b > hi) return false;
+        }
+    }
+    return true;
+}
+
+// MessagePack 不校验字符串内容，损坏的快照可能带出非法 UTF-8，之后输出时 dump 会出错
+static bool valid_strings(const json& value) {
+    if (value.is_string()) return valid_utf8(value.get_ref<const std::string&>());
+    if (value.is_object()) {
+        for (auto it = value.begin(); it != value.end(); ++it) {
+            if (!valid_utf8(it.key()) || !valid_strings(it.value())) return false;
+        }
+    } else if (value.is_array()) {
+        for (const json& element : value) {
+            if (!valid_strings(element)) return false;
+        }
+    }
+    return true;
+}
+
+std::string SnapshotReader::get_string() {
+    std::vector<char> chars;
+    if (!get_vector(chars)) return std::string();
+    std::string s(chars.data(), chars.size());
+    if (!valid_utf8(s)) {
+        fail();
+        return std::string();
+    }
+    return s;
+}
+
+json SnapshotReader::get_object() {
+    std::vector<uint8_t> packed;
+    if (!get_vector(packed)) return json::object();
+    json value = json::from_msgpack(packed.begin(), packed.end(), true, false);
+    if (value.is_discarded() || !value.is_object() || !valid_strings(value)) {
+        fail();
+        return json::object();
+    }
+    return value;
+}
+
+static void put_stats(SnapshotWriter& writer, const ParseResult& stats) {
+    writer.put<int32_t>(stats.bpm_count);
+    writer.put<double>(stats.min_bpm);
+    writer.put<double>(stats.max_bpm);
+    writer.put<int32_t>(stats.rpe_version);
+    writer.put_string(stats.charter);
+    writer.put_string(stats.composer);
+    writer.put_string(stats.id);
+    writer.put_string(stats.level);
+    writer.put_string(stats.name);
+    writer.put<int32_t>(stats.judge_line_count);
+    writer.put_vector(stats.judge_line_stats);
+    writer.put<int32_t>(stats.error_code);
+}
+
+static void get_stats(SnapshotReader& reader, ParseResult& stats) {
+    stats.bpm_count = reader.get<int32_t>();
+    stats.min_bpm = reader.get<double>();
+    stats.max_bpm = reader.get<double>();
+    stats.rpe_version = reader.get<int32_t>();
+    stats.charter = reader.get_string();
+    stats.composer = reader.get_string();
+    stats.id = reader.get_string();
+    stats.level = reader.get_string();
+    stats.name = reader.get_string();
+    stats.judge_line_count = reader.get<int32_t>();
+    reader.get_vector(stats.judge_line_stats);
+    stats.error_code = reader.get<int32_t>();
+}
+
+bool write_chart_snapshot(const ParsedChart& chart, const ParseResult& stats,
+                          bool has_hash, uint64_t content_hash, OutputBuffer& out) {
+    SnapshotWriter writer(out);
+    out.append(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    writer.put<uint32_t>(CHART_SNAPSHOT_VERSION);
+    writer.put<uint32_t>(BYTE_ORDER_MARK);
+    writer.put<uint8_t>(has_hash ? 1 : 0);
+    writer.put<uint64_t>(has_hash ? content_hash : 0);
+    put_stats(writer, stats);
+
+    writer.put_object(chart.frame);
+    writer.put<uint8_t>(chart.has_judge_line_list ? 1 : 0);
+    writer.put<uint64_t>(chart.lines.size());
+    for (const JudgeLineStore& line : chart.lines) {
+        writer.put_object(line.frame);
+        for (const auto& layer : line.events) {
+            for (const ItemColumns& items : layer) items.save(writer);
+        }
+        line.notes.save(writer);
+    }
+    return !writer.failed();
+}
+
+std::shared_ptr<ParsedChart> read_chart_snapshot(const unsigned char* data, size_t size, ParseResult& stats,
+                                                 bool& has_hash, uint64_t& content_hash) {
+    if (!data || size < sizeof(SNAPSHOT_MAGIC) || memcmp(data, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+        return nullptr;
+    }
+    SnapshotReader reader(data + sizeof(SNAPSHOT_MAGIC), size - sizeof(SNAPSHOT_MAGIC));
+    if (reader.get<uint32_t>() != CHART_SNAPSHOT_VERSION || reader.get<uint32_t>() != BYTE_ORDER_MARK) {
+        return nullptr;
+    }
+    has_hash = reader.get<uint8_t>() != 0;
+    content_hash = reader.get<uint64_t>();
+    get_stats(reader, stats);
+
+    auto chart = std::make_shared<ParsedChart>();
+    chart->frame = reader.get_object();
+    chart->has_judge_line_list = reader.get<uint8_t>() != 0;
+    uint64_t line_count = reader.get<uint64_t>();
+    // 每条判定线至少占一个 frame 的长度字段，借此挡住损坏的行数
+    if (!reader.ok() || line_count > size / sizeof(uint64_t)) return nullptr;
+    chart->lines.resize(line_count);
+    for (JudgeLineStore& line : chart->lines) {
+        line.frame = reader.get_object();
+        for (auto& layer : line.events) {
+            for (ItemColumns& items : layer) items.load(reader);
+        }
+        line.notes.load(reader);
+        if (!reader.ok()) return nullptr;
+    }
+    if (!reader.ok() || !reader.at_end()) return nullptr;
+    return chart;
+}
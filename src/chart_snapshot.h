@@ -0,0 +1,116 @@
+#pragma once
+
+/* 已解析谱面的二进制快照
+ * 把统计信息、紧凑存储的各列以及时间索引按内存中的布局原样写出，
+ * 恢复时逐段 memcpy 回 vector，不再解析 JSON、也不必重建索引。
+ * 页面把快照存进 IndexedDB，刷新后以它恢复各卡片。
+ *
+ * 格式（小端）：
+ *   "PCSN" | u32 版本 | u32 字节序标记 | u8 有无内容哈希 | u64 内容哈希 | 统计信息 | 谱面
+ * frame 与旁路表中的 json 以 MessagePack 保存；数组为 u64 元素个数 + 元素的原始字节。
+ * 格式有任何变化都要增加 CHART_SNAPSHOT_VERSION，旧版本的快照读取时被拒绝，由前端改用原始文件重新载入。
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "chart_core.h"
+#include "json_writer.h"
+
+struct ParsedChart;
+
+constexpr uint32_t CHART_SNAPSHOT_VERSION = 1;
+// 快照无效（不是快照、版本不符或数据损坏）时 load_chart_snapshot 返回的错误码，接在 PezError 之后
+constexpr int SNAPSHOT_INVALID = -7;
+
+// 顺序写出快照的各个字段
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(OutputBuffer& out) : out_(out) {}
+
+    template <typename T>
+    void put(const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "只能直接写出平凡类型");
+        out_.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    void put_vector(const std::vector<T>& values) {
+        static_assert(std::is_trivially_copyable<T>::value, "只能直接写出平凡类型");
+        put<uint64_t>(values.size());
+        if (!values.empty()) out_.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    }
+
+    void put_string(const std::string& s);
+    // frame 与旁路表都是 json 对象
+    void put_object(const json& value);
+
+    bool failed() const { return out_.failed(); }
+
+private:
+    OutputBuffer& out_;
+};
+
+// 顺序读取快照，越界或格式错误后 ok() 为 false，之后的读取都返回空值
+class SnapshotReader {
+public:
+    SnapshotReader(const unsigned char* data, size_t size) : data_(data), size_(size) {}
+
+    template <typename T>
+    T get() {
+        static_assert(std::is_trivially_copyable<T>::value, "只能直接读取平凡类型");
+        T value{};
+        if (take(sizeof(T))) memcpy(&value, data_ + pos_ - sizeof(T), sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    bool get_vector(std::vector<T>& values) {
+        static_assert(std::is_trivially_copyable<T>::value, "只能直接读取平凡类型");
+        uint64_t count = get<uint64_t>();
+        if (!ok_ || count > (size_ - pos_) / sizeof(T)) return fail();
+        values.resize(count);
+        if (count > 0) memcpy(values.data(), data_ + pos_, count * sizeof(T));
+        pos_ += count * sizeof(T);
+        return true;
+    }
+
+    // 字符串须是合法的 UTF-8，json 须是对象，否则视为损坏
+    std::string get_string();
+    json get_object();
+
+    bool ok() const { return ok_; }
+    bool at_end() const { return pos_ == size_; }
+    bool fail() {
+        ok_ = false;
+        return false;
+    }
+
+private:
+    const unsigned char* data_;
+    size_t size_;
+    size_t pos_ = 0;
+    bool ok_ = true;
+
+    bool take(size_t n) {
+        if (!ok_ || n > size_ - pos_) return fail();
+        pos_ += n;
+        return true;
+    }
+};
+
+/* 写出谱面快照，has_hash 为 false 时 content_hash 不保存
+ * 内存不足时返回 false
+ */
+bool write_chart_snapshot(const ParsedChart& chart, const ParseResult& stats,
+                          bool has_hash, uint64_t content_hash, OutputBuffer& out);
+
+/* 读取谱面快照；不是快照、版本不符或数据损坏时返回 nullptr
+ * has_hash / content_hash 为写出时记下的内容哈希
+ */
+std::shared_ptr<ParsedChart> read_chart_snapshot(const unsigned char* data, size_t size, ParseResult& stats,
+                                                 bool& has_hash, uint64_t& content_hash);
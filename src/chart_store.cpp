@@ -0,0 +1,528 @@
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#include "chart_store.h"
+#include "chart_snapshot.h"
+#include "json_insitu_parser.h"
+#include "json_writer.h"
+
+static const char* const EVENT_FIELD_NAMES[] = {
+    "start", "end", "easingType", "easingLeft", "easingRight", "bezier", "linkgroup"
+};
+static const char* const NOTE_FIELD_NAMES[] = {
+    "type", "above", "positionX", "speed", "alpha", "size", "yOffset", "visibleTime", "isFake"
+};
+
+const FieldSchema EVENT_FIELDS = {EVENT_FIELD_NAMES, sizeof(EVENT_FIELD_NAMES) / sizeof(EVENT_FIELD_NAMES[0])};
+const FieldSchema NOTE_FIELDS = {NOTE_FIELD_NAMES, sizeof(NOTE_FIELD_NAMES) / sizeof(NOTE_FIELD_NAMES[0])};
+
+int FieldSchema::find(const std::string& key) const {
+    for (int i = 0; i < count; ++i) {
+        if (key == names[i]) return i;
+    }
+    return -1;
+}
+
+// 能按列还原的时间：恰好三个 int 范围内的整数，且分母为正
+static bool is_plain_time(const json& arr) {
+    if (arr.size() != 3) return false;
+    for (const auto& v : arr) {
+        if (!v.is_number_integer()) return false;
+        if (v.is_number_unsigned()) {
+            if (v.get<json::number_unsigned_t>() > static_cast<json::number_unsigned_t>(INT_MAX)) return false;
+        } else {
+            json::number_integer_t i = v.get<json::number_integer_t>();
+            if (i < INT_MIN || i > INT_MAX) return false;
+        }
+    }
+    return arr[2].get<json::number_integer_t>() > 0;
+}
+
+// double 能精确表示的数值才放进列里，过大的整数留在旁路表
+static bool to_column_value(const json& value, double& out, bool& is_integer) {
+    constexpr int64_t exact_limit = int64_t(1) << 53;
+    if (value.is_number_float()) {
+        out = value.get<double>();
+        is_integer = false;
+        return true;
+    }
+    if (value.is_number_unsigned()) {
+        json::number_unsigned_t u = value.get<json::number_unsigned_t>();
+        if (u > static_cast<json::number_unsigned_t>(exact_limit)) return false;
+        out = static_cast<double>(u);
+        is_integer = true;
+        return true;
+    }
+    if (value.is_number_integer()) {
+        json::number_integer_t i = value.get<json::number_integer_t>();
+        if (i < -exact_limit || i > exact_limit) return false;
+        out = static_cast<double>(i);
+        is_integer = true;
+        return true;
+    }
+    return false;
+}
+
+template <typename T>
+static void shrink(std::vector<T>& v) {
+    if (v.capacity() > v.size()) v.shrink_to_fit();
+}
+
+ItemColumns::ItemColumns(const FieldSchema& schema) : schema_(&schema) {
+    values_.resize(schema.count);
+}
+
+void ItemColumns::append(json& item) {
+    if (!has_start_end_time(item)) return;
+
+    json& start = item["startTime"];
+    json& end = item["endTime"];
+    bool plain_start = is_plain_time(start);
+    bool plain_end = is_plain_time(end);
+    start_time_.push_back(parse_time_array(start));
+    end_time_.push_back(parse_time_array(end));
+
+    for (auto& column : values_) column.push_back(0.0);
+    uint32_t present = 0;
+    uint32_t integer = 0;
+    json extra;
+
+    for (auto it = item.begin(); it != item.end(); ++it) {
+        const std::string& key = it.key();
+        if (key == "startTime" || key == "endTime") {
+            if (!(key == "startTime" ? plain_start : plain_end)) {
+                extra[key] = std::move(it.value());
+            }
+            continue;
+        }
+        int field = schema_->find(key);
+        bool is_integer = false;
+        if (field >= 0 && to_column_value(it.value(), values_[field].back(), is_integer)) {
+            present |= 1u << field;
+            if (is_integer) integer |= 1u << field;
+            continue;
+        }
+        extra[key] = std::move(it.value());
+    }
+
+    present_.push_back(present);
+    integer_.push_back(integer);
+    if (extra.is_null()) {
+        extra_.push_back(-1);
+    } else {
+        extra_.push_back(static_cast<int32_t>(extras_.size()));
+        extras_.push_back(std::move(extra));
+    }
+}
+
+void ItemColumns::finish() {
+    // 追加时按倍数扩容，载入完成后把多余的容量还回去
+    shrink(start_time_);
+    shrink(end_time_);
+    for (auto& column : values_) shrink(column);
+    shrink(present_);
+    shrink(integer_);
+    shrink(extra_);
+    shrink(extras_);
+    index_.build(start_time_, end_time_);
+}
+
+void ItemColumns::clear() {
+    *this = ItemColumns(*schema_);
+}
+
+json ItemColumns::to_json(size_t row) const {
+    json item = json::object();
+    const TimeSignature& st = start_time_[row];
+    const TimeSignature& et = end_time_[row];
+    item["startTime"] = {st.measure, st.numerator, st.denominator};
+    item["endTime"] = {et.measure, et.numerator, et.denominator};
+
+    uint32_t present = present_[row];
+    uint32_t integer = integer_[row];
+    for (int field = 0; field < schema_->count; ++field) {
+        if (!(present & (1u << field))) continue;
+        double value = values_[field][row];
+        if (integer & (1u << field)) {
+            item[schema_->names[field]] = static_cast<json::number_integer_t>(value);
+        } else {
+            item[schema_->names[field]] = value;
+        }
+    }
+
+    // 旁路表中的 startTime / endTime 是无法按列还原的原始数组，覆盖上面的值
+    if (extra_[row] >= 0) {
+        const json& extra = extras_[extra_[row]];
+        for (auto it = extra.begin(); it != extra.end(); ++it) {
+            item[it.key()] = it.value();
+        }
+    }
+    return item;
+}
+
+// 输出时的键顺序，与 json 对象（std::map）一致；START_TIME_KEY / END_TIME_KEY 代表两个时间数组
+constexpr int START_TIME_KEY = -1;
+constexpr int END_TIME_KEY = -2;
+
+static const char* key_name(const FieldSchema& schema, int key) {
+    if (key == START_TIME_KEY) return "startTime";
+    if (key == END_TIME_KEY) return "endTime";
+    return schema.names[key];
+}
+
+static std::vector<int> sorted_keys(const FieldSchema& schema) {
+    std::vector<int> keys = {START_TIME_KEY, END_TIME_KEY};
+    for (int field = 0; field < schema.count; ++field) keys.push_back(field);
+    std::sort(keys.begin(), keys.end(), [&schema](int a, int b) {
+        return std::string(key_name(schema, a)) < std::string(key_name(schema, b));
+    });
+    return keys;
+}
+
+static const std::vector<int>& key_order(const FieldSchema& schema) {
+    static const std::vector<int> event_order = sorted_keys(EVENT_FIELDS);
+    static const std::vector<int> note_order = sorted_keys(NOTE_FIELDS);
+    return &schema == &NOTE_FIELDS ? note_order : event_order;
+}
+
+static void write_time(JsonWriter& writer, const TimeSignature& ts) {
+    writer.begin_array();
+    writer.value(static_cast<int64_t>(ts.measure));
+    writer.value(static_cast<int64_t>(ts.numerator));
+    writer.value(static_cast<int64_t>(ts.denominator));
+    writer.end_array();
+}
+
+void ItemColumns::write(size_t row, JsonWriter& writer) const {
+    static const json empty_extra = json::object();
+    const json& extra = extra_[row] >= 0 ? extras_[extra_[row]] : empty_extra;
+    auto extra_it = extra.begin();
+    uint32_t present = present_[row];
+    uint32_t integer = integer_[row];
+
+    writer.begin_object();
+    // 列中的字段与旁路表各自有序，按键归并输出；同名时旁路表优先
+    for (int key : key_order(*schema_)) {
+        if (key >= 0 && !(present & (1u << key))) continue;
+        const char* name = key_name(*schema_, key);
+        while (extra_it != extra.end() && extra_it.key() < name) {
+            writer.key(extra_it.key());
+            writer.value(extra_it.value());
+            ++extra_it;
+        }
+        if (extra_it != extra.end() && extra_it.key() == name) continue;
+
+        writer.key(name);
+        if (key == START_TIME_KEY) {
+            write_time(writer, start_time_[row]);
+        } else if (key == END_TIME_KEY) {
+            write_time(writer, end_time_[row]);
+        } else if (integer & (1u << key)) {
+            writer.value(static_cast<int64_t>(values_[key][row]));
+        } else {
+            writer.value(values_[key][row]);
+        }
+    }
+    for (; extra_it != extra.end(); ++extra_it) {
+        writer.key(extra_it.key());
+        writer.value(extra_it.value());
+    }
+    writer.end_object();
+}
+
+// json 树占用的字节数，按节点大小加上字符串与容器的容量粗略估计
+static size_t json_memory_size(const json& value) {
+    size_t bytes = sizeof(json);
+    switch (value.type()) {
+        case json::value_t::string:
+            bytes += value.get_ref<const std::string&>().capacity();
+            break;
+        case json::value_t::array:
+            for (const json& item : value) bytes += json_memory_size(item);
+            break;
+        case json::value_t::object:
+            // std::map 的每个节点另有键与三个指针的开销
+            for (auto it = value.begin(); it != value.end(); ++it) {
+                bytes += json_memory_size(it.value()) + sizeof(std::string) + it.key().capacity() + 4 * sizeof(void*);
+            }
+            break;
+        default:
+            break;
+    }
+    return bytes;
+}
+
+size_t ItemColumns::memory_size() const {
+    size_t bytes = (start_time_.capacity() + end_time_.capacity()) * sizeof(TimeSignature) +
+        (present_.capacity() + integer_.capacity()) * sizeof(uint32_t) +
+        extra_.capacity() * sizeof(int32_t) + index_.memory_size();
+    for (const auto& column : values_) bytes += column.capacity() * sizeof(double);
+    for (const json& extra : extras_) bytes += json_memory_size(extra);
+    return bytes;
+}
+
+void ItemColumns::save(SnapshotWriter& writer) const {
+    writer.put_vector(start_time_);
+    writer.put_vector(end_time_);
+    for (const auto& column : values_) writer.put_vector(column);
+    writer.put_vector(present_);
+    writer.put_vector(integer_);
+    writer.put_vector(extra_);
+    writer.put<uint64_t>(extras_.size());
+    for (const json& extra : extras_) writer.put_object(extra);
+    index_.save(writer);
+}
+
+void ItemColumns::load(SnapshotReader& reader) {
+    reader.get_vector(start_time_);
+    reader.get_vector(end_time_);
+    for (auto& column : values_) reader.get_vector(column);
+    reader.get_vector(present_);
+    reader.get_vector(integer_);
+    reader.get_vector(extra_);
+    uint64_t extra_count = reader.get<uint64_t>();
+    if (!reader.ok() || extra_count > extra_.size()) {
+        reader.fail();
+        return;
+    }
+    extras_.resize(extra_count);
+    for (json& extra : extras_) extra = reader.get_object();
+    index_.load(reader);
+
+    // 各列的行数必须一致，旁路表的下标不能越界
+    size_t rows = start_time_.size();
+    bool consistent = end_time_.size() == rows && present_.size() == rows &&
+        integer_.size() == rows && extra_.size() == rows && index_.size() == rows;
+    for (const auto& column : values_) consistent = consistent && column.size() == rows;
+    for (int32_t k : extra_) consistent = consistent && k >= -1 && k < static_cast<int64_t>(extras_.size());
+    if (!consistent) reader.fail();
+}
+
+size_t chart_memory_size(const ParsedChart& chart) {
+    size_t bytes = sizeof(ParsedChart) + json_memory_size(chart.frame);
+    for (const JudgeLineStore& line : chart.lines) {
+        bytes += sizeof(JudgeLineStore) + json_memory_size(line.frame) + line.notes.memory_size();
+        for (const auto& layer : line.events) {
+            for (const ItemColumns& items : layer) bytes += items.memory_size();
+        }
+    }
+    return bytes;
+}
+
+// frame 中的字段逐个写进当前对象；紧凑存储的 frame 总是对象
+static void write_frame_fields(JsonWriter& writer, const json& frame) {
+    for (auto it = frame.begin(); it != frame.end(); ++it) {
+        writer.key(it.key());
+        writer.value(it.value());
+    }
+}
+
+static void write_items(JsonWriter& writer, const ItemColumns& items) {
+    writer.begin_array();
+    for (size_t row = 0; row < items.size(); ++row) items.write(row, writer);
+    writer.end_array();
+}
+
+void write_chart(const ParsedChart& chart, JsonWriter& writer) {
+    writer.begin_object();
+    write_frame_fields(writer, chart.frame);
+    if (chart.has_judge_line_list) {
+        writer.key("judgeLineList");
+        writer.begin_array();
+        for (const JudgeLineStore& line : chart.lines) {
+            writer.begin_object();
+            write_frame_fields(writer, line.frame);
+            writer.key("eventLayers");
+            writer.begin_array();
+            for (const auto& layer : line.events) {
+                writer.begin_object();
+                for (int type = 0; type < EVENT_TYPE_COUNT; ++type) {
+                    writer.key(EVENT_TYPES[type]);
+                    write_items(writer, layer[type]);
+                }
+                writer.end_object();
+            }
+            writer.end_array();
+            writer.key("notes");
+            write_items(writer, line.notes);
+            writer.end_object();
+        }
+        writer.end_array();
+    }
+    writer.end_object();
+}
+
+// 与 DOM 上 items() 的遍历结果一致：非对象的值也能得到对应的键
+static json frame_from_items(const json& value, const char* excluded1, const char* excluded2 = nullptr) {
+    json frame = json::object();
+    for (auto& [key, item] : value.items()) {
+        if (key == excluded1 || (excluded2 && key == excluded2)) continue;
+        frame[key] = item;
+    }
+    return frame;
+}
+
+bool build_chart_store(const char* json_str, size_t json_len, ParsedChart& chart) {
+    if (json_str && json_len > 0) {
+        for (JsonBackend backend : JSON_BACKENDS) {
+            chart = ParsedChart();
+            ChartStoreBuilder builder(chart);
+            if (sax_parse_json(backend, json_str, json_str + json_len, builder)) return true;
+        }
+    }
+    chart = ParsedChart();
+    return false;
+}
+
+bool ChartStoreBuilder::key(std::string_view val) {
+    if (capture_ != Capture::None) {
+        std::string s(val);
+        return dom_->key(s);
+    }
+    if (skip_depth_ > 0) return true;
+
+    Frame& top = stack_.back();
+    top.field = Field::Skip;
+    switch (top.node) {
+        case Node::Root:
+            if (val == "judgeLineList") {
+                top.field = Field::JudgeLineList;
+            } else {
+                top.field = Field::Frame;
+                top.slot = &chart_.frame[std::string(val)];
+            }
+            break;
+        case Node::JudgeLine:
+            if (val == "eventLayers") {
+                top.field = Field::EventLayers;
+            } else if (val == "notes") {
+                top.field = Field::Notes;
+            } else {
+                top.field = Field::Frame;
+                top.slot = &chart_.lines.back().frame[std::string(val)];
+            }
+            break;
+        case Node::EventLayer:
+            for (int type = 0; type < EVENT_TYPE_COUNT; ++type) {
+                if (val == EVENT_TYPES[type]) {
+                    top.field = Field::EventArray;
+                    top.items = &chart_.lines.back().events[top.position][type];
+                    break;
+                }
+            }
+            break;
+        default:
+            break;
+    }
+    return true;
+}
+
+bool ChartStoreBuilder::route(bool container, bool is_array) {
+    bool is_object = container && !is_array;
+    Capture kind = Capture::None;
+    json* target = &captured_;
+
+    if (stack_.empty()) {
+        if (is_object) {
+            chart_.frame = json::object();
+            stack_.push_back({Node::Root, Field::Skip, 0, nullptr, nullptr});
+            return false;
+        }
+        kind = Capture::RootValue;
+    } else {
+        Frame& top = stack_.back();
+        switch (top.node) {
+            case Node::Root:
+            case Node::JudgeLine:
+            case Node::EventLayer:
+                switch (top.field) {
+                    case Field::Frame:
+                        kind = Capture::Frame;
+                        target = top.slot;
+                        break;
+                    case Field::JudgeLineList:
+                        chart_.lines.clear();
+                        chart_.has_judge_line_list = is_array;
+                        if (is_array) {
+                            stack_.push_back({Node::JudgeLineList, Field::Skip, 0, nullptr, nullptr});
+                            return false;
+                        }
+                        break;
+                    case Field::EventLayers: {
+                        JudgeLineStore& line = chart_.lines.back();
+                        for (auto& layer : line.events) {
+                            for (auto& items : layer) items.clear();
+                        }
+                        if (is_array) {
+                            stack_.push_back({Node::EventLayers, Field::Skip, 0, nullptr, nullptr});
+                            return false;
+                        }
+                        break;
+                    }
+                    case Field::Notes:
+                    case Field::EventArray: {
+                        ItemColumns* items = top.field == Field::Notes ? &chart_.lines.back().notes : top.items;
+                        items->clear();
+                        if (is_array) {
+                            stack_.push_back({Node::ItemArray, Field::Skip, 0, nullptr, items});
+                            return false;
+                        }
+                        break;
+                    }
+                    case Field::Skip:
+                        break;
+                }
+                break;
+            case Node::JudgeLineList:
+                chart_.lines.emplace_back();
+                if (is_object) {
+                    stack_.push_back({Node::JudgeLine, Field::Skip, 0, nullptr, nullptr});
+                    return false;
+                }
+                kind = Capture::LineValue;
+                break;
+            case Node::EventLayers: {
+                int layer = top.position++;
+                if (is_object && layer < EVENT_LAYER_COUNT) {
+                    stack_.push_back({Node::EventLayer, Field::Skip, layer, nullptr, nullptr});
+                    return false;
+                }
+                break;
+            }
+            case Node::ItemArray:
+                if (is_object) {
+                    kind = Capture::Item;
+                    capture_items_ = top.items;
+                }
+                break;
+        }
+    }
+
+    if (kind == Capture::None) {
+        if (container) skip_depth_ = 1;
+        return false;
+    }
+    capture_ = kind;
+    dom_.emplace(*target, false);
+    return true;
+}
+
+void ChartStoreBuilder::finish_capture() {
+    dom_.reset();
+    switch (capture_) {
+        case Capture::RootValue:
+            chart_.frame = frame_from_items(captured_, "judgeLineList");
+            break;
+        case Capture::LineValue:
+            chart_.lines.back().frame = frame_from_items(captured_, "eventLayers", "notes");
+            break;
+        case Capture::Item:
+            capture_items_->append(captured_);
+            break;
+        default:
+            break;
+    }
+    captured_ = json();
+    capture_ = Capture::None;
+}
@@ -0,0 +1,209 @@
+#pragma once
+
+/* 载入谱面的紧凑存储
+ * 事件和音符不再以 json 对象（每个都是一棵带字符串键的 std::map）保存，
+ * 而是按字段拆成若干列：开始/结束时间、常见的数值字段各占一个数组，
+ * 其余不认识的字段（以及类型不寻常的值）放进旁路表，保证能原样还原成 RPE JSON。
+ * 合并时的时间筛选直接在这些数组上进行。
+ */
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "chart_core.h"
+#include "chart_index.h"
+
+class JsonWriter;
+class SnapshotWriter;
+class SnapshotReader;
+
+// 某类元素中按列保存的数值字段
+struct FieldSchema {
+    const char* const* names;
+    int count;
+
+    int find(const std::string& key) const;
+};
+
+extern const FieldSchema EVENT_FIELDS;   // start, end, easingType, easingLeft, easingRight, bezier, linkgroup
+extern const FieldSchema NOTE_FIELDS;    // type, above, positionX, speed, alpha, size, yOffset, visibleTime, isFake
+
+/* 一组事件（某层的某种事件）或一条判定线的音符
+ * 只收录带有 startTime / endTime 数组的元素，其余元素合并时本来就不会被复制。
+ */
+class ItemColumns {
+public:
+    explicit ItemColumns(const FieldSchema& schema = EVENT_FIELDS);
+
+    // 从解析出的单个元素转换，item 中的值可能被移走
+    void append(json& item);
+    // 全部元素追加完以后建立时间索引
+    void finish();
+    void clear();
+
+    // 还原第 row 个元素的 RPE JSON
+    json to_json(size_t row) const;
+    // 直接写出第 row 个元素，结果与 to_json(row) 的序列化一致
+    void write(size_t row, JsonWriter& writer) const;
+
+    size_t size() const { return start_time_.size(); }
+    const TimeRangeIndex& index() const { return index_; }
+    // 各列、旁路表与索引占用的字节数（估计值）
+    size_t memory_size() const;
+
+    // 按原样写出/读回各列、旁路表与索引（chart_snapshot.h），读取失败时 reader.ok() 为 false
+    void save(SnapshotWriter& writer) const;
+    void load(SnapshotReader& reader);
+
+private:
+    const FieldSchema* schema_;
+    std::vector<TimeSignature> start_time_;
+    std::vector<TimeSignature> end_time_;
+    std::vector<std::vector<double>> values_;   // values_[字段][行]，缺失时为 0
+    std::vector<uint32_t> present_;             // 第 i 位：字段 i 存在
+    std::vector<uint32_t> integer_;             // 第 i 位：字段 i 原本是整数
+    std::vector<int32_t> extra_;                // 指向 extras_ 的下标，-1 表示没有
+    std::vector<json> extras_;                  // 不认识的字段，以及无法按列保存的值
+    TimeRangeIndex index_;
+};
+
+struct JudgeLineStore {
+    json frame = json::object();   // 判定线中除 eventLayers / notes 以外的字段
+    ItemColumns events[EVENT_LAYER_COUNT][EVENT_TYPE_COUNT];
+    ItemColumns notes{NOTE_FIELDS};
+};
+
+struct ParsedChart {
+    json frame = json::object();       // 谱面中除 judgeLineList 以外的字段
+    bool has_judge_line_list = false;  // judgeLineList 是否为数组
+    std::vector<JudgeLineStore> lines;
+};
+
+// 解析谱面 JSON 并转换为紧凑存储，失败时返回 false，chart 保持为空谱面
+bool build_chart_store(const char* json_str, size_t json_len, ParsedChart& chart);
+
+// 估计谱面常驻内存的字节数，已解析谱面的缓存按它计算预算
+size_t chart_memory_size(const ParsedChart& chart);
+
+/* 把紧凑存储写回 RPE JSON，再经 build_chart_store 解析得到相同的紧凑存储
+ * 只包含紧凑存储中保留的内容（前 4 层事件、带时间的元素），用于缓存换出谱面时的序列化。
+ */
+void write_chart(const ParsedChart& chart, JsonWriter& writer);
+
+/* 把 SAX 事件收集成 json 值的处理器（ChartStoreBuilder 的片段、网页分块传入的表单共用）
+ * json_sax_dom_parser 属于 nlohmann 的内部实现，模板参数在不同版本间变过，随附的 json.hpp 升级时须重新核对。
+ */
+static_assert(NLOHMANN_JSON_VERSION_MAJOR == 3 && NLOHMANN_JSON_VERSION_MINOR == 12,
+              "JsonDomSax 依赖 nlohmann json 3.12 的 detail::json_sax_dom_parser");
+using JsonDomSax = nlohmann::detail::json_sax_dom_parser<json, nlohmann::detail::iterator_input_adapter<const char*>>;
+
+/* 把谱面的 SAX 事件直接转换成 ParsedChart，不构建整份 DOM
+ * 只有 frame 部分以及单个事件/音符会临时收集成 json，元素转换完立即释放。
+ * 重复的键按 DOM 的规则处理：后出现的覆盖先出现的。
+ */
+class ChartStoreBuilder {
+public:
+    explicit ChartStoreBuilder(ParsedChart& chart) : chart_(chart) {}
+
+    bool null() { return scalar([&](DomSax& d) { return d.null(); }); }
+    bool boolean(bool val) { return scalar([&](DomSax& d) { return d.boolean(val); }); }
+    bool number_integer(json::number_integer_t val) { return scalar([&](DomSax& d) { return d.number_integer(val); }); }
+    bool number_unsigned(json::number_unsigned_t val) { return scalar([&](DomSax& d) { return d.number_unsigned(val); }); }
+    bool number_float(json::number_float_t val, std::string_view) { return scalar([&](DomSax& d) { return d.number_float(val, std::string()); }); }
+    bool string(std::string_view val) {
+        return scalar([&](DomSax& d) {
+            std::string s(val);
+            return d.string(s);
+        });
+    }
+    bool binary(json::binary_t& val) { return scalar([&](DomSax& d) { return d.binary(val); }); }
+
+    bool start_object(std::size_t n) { return open(false, [&](DomSax& d) { return d.start_object(n); }); }
+    bool start_array(std::size_t n) { return open(true, [&](DomSax& d) { return d.start_array(n); }); }
+    bool end_object() { return close([&](DomSax& d) { return d.end_object(); }); }
+    bool end_array() { return close([&](DomSax& d) { return d.end_array(); }); }
+    bool key(std::string_view val);
+
+    bool parse_error(std::size_t, const std::string&, const json::exception&) { return false; }
+
+private:
+    using DomSax = JsonDomSax;
+
+    enum class Node { Root, JudgeLineList, JudgeLine, EventLayers, EventLayer, ItemArray };
+    enum class Field { Skip, Frame, JudgeLineList, EventLayers, Notes, EventArray };
+    // 整段收集成 json 的值最终交给谁
+    enum class Capture { None, Frame, RootValue, LineValue, Item };
+
+    struct Frame {
+        Node node;
+        Field field;          // 对象中当前键的含义
+        int position;         // 数组中下一个元素的下标；EventLayer 中为层号
+        json* slot;           // Field::Frame 时值写入的位置
+        ItemColumns* items;   // Field::EventArray 或 Node::ItemArray 对应的列
+    };
+
+    ParsedChart& chart_;
+    std::vector<Frame> stack_;
+    int skip_depth_ = 0;   // 处于不关心的子树中时只记录深度
+
+    Capture capture_ = Capture::None;
+    int capture_depth_ = 0;
+    json captured_;
+    ItemColumns* capture_items_ = nullptr;
+    std::optional<DomSax> dom_;
+
+    /* 一个值开始时决定去向：压入结构栈、整段收集或跳过
+     * 需要收集时返回 true，此时 dom_ 已就绪。
+     */
+    bool route(bool container, bool is_array);
+    void finish_capture();
+
+    template <typename F>
+    bool scalar(F&& emit) {
+        if (capture_ != Capture::None) return emit(*dom_);
+        if (skip_depth_ > 0) return true;
+        if (route(false, false)) {
+            emit(*dom_);
+            finish_capture();
+        }
+        return true;
+    }
+
+    template <typename F>
+    bool open(bool is_array, F&& emit) {
+        if (capture_ != Capture::None) {
+            capture_depth_++;
+            return emit(*dom_);
+        }
+        if (skip_depth_ > 0) {
+            skip_depth_++;
+            return true;
+        }
+        if (route(true, is_array)) {
+            capture_depth_ = 1;
+            return emit(*dom_);
+        }
+        return true;
+    }
+
+    template <typename F>
+    bool close(F&& emit) {
+        if (capture_ != Capture::None) {
+            emit(*dom_);
+            if (--capture_depth_ == 0) finish_capture();
+            return true;
+        }
+        if (skip_depth_ > 0) {
+            skip_depth_--;
+            return true;
+        }
+        if (stack_.back().node == Node::ItemArray) {
+            stack_.back().items->finish();
+        }
+        stack_.pop_back();
+        return true;
+    }
+};
@@ -0,0 +1,258 @@
+/* 本地命令行工具
+ * 与网页共用 chart_core，便于在服务器上批量合并谱面或用常规工具做性能分析。
+ *
+ * 用法：
+ *   chart_merge parse [--stats] <谱面.json|谱面.pez>...
+ *   chart_merge merge -f <表单.json> [-o <输出.json>] [--indent N] [--threads N] [--budget MB] [--pez <原包.pez>] [--stats] <谱面.json|谱面.pez>...
+ *
+ * 表单格式与网页提交给 merge_cards 的一致（卡片也可以像旧的 finalize_merge 那样自带 chartJson）；
+ * 没有 chartJson 字段的卡片按顺序依次使用命令行给出的谱面文件。
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "chart_core.h"
+#include "chart_cache.h"
+#include "json_writer.h"
+#include "perf.h"
+
+static void print_usage() {
+    fprintf(stderr,
+        "用法:\n"
+        "  chart_merge parse [--stats] <谱面.json|谱面.pez>...\n"
+        "  chart_merge merge -f <表单.json> [-o <输出.json>] [--indent N] [--threads N] [--budget MB] [--pez <原包.pez>] [--stats] <谱面.json|谱面.pez>...\n"
+        "\n"
+        "  -f, --form     合并表单（与网页提交的格式一致）\n"
+        "  -o, --output   输出文件，缺省时写到标准输出\n"
+        "  --indent N     缩进空格数，-1 表示紧凑输出（默认 3）\n"
+        "  --threads N    合并时的线程数，0 表示按硬件线程数（默认 0），输出与单线程相同\n"
+        "  --budget MB    已解析谱面常驻内存的上限，超出时换出最久未用的谱面（默认不限）\n"
+        "  --pez FILE     把结果连同该 PEZ 中的音乐、曲绘等资源打包成新的 PEZ\n"
+        "  --stats        结束后向标准错误输出各阶段的耗时、字节数与峰值内存（JSON）\n");
+}
+
+static bool read_file(const std::string& path, std::string& out) {
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (!fp) return false;
+    out.clear();
+    char buf[1 << 16];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        out.append(buf, n);
+    }
+    bool ok = !ferror(fp);
+    fclose(fp);
+    return ok;
+}
+
+static bool ends_with(const std::string& s, const char* suffix) {
+    size_t len = strlen(suffix);
+    return s.size() >= len && s.compare(s.size() - len, len, suffix) == 0;
+}
+
+// 读取谱面文件，PEZ 会先解出其中的 JSON
+static bool load_chart_file(const std::string& path, std::string& chart) {
+    std::string raw;
+    if (!read_file(path, raw)) {
+        fprintf(stderr, "无法读取文件: %s\n", path.c_str());
+        return false;
+    }
+    if (!ends_with(path, ".pez")) {
+        chart = std::move(raw);
+        return true;
+    }
+
+    size_t json_len = 0;
+    int error_code = PEZ_OK;
+    char* json_data = extract_pez_chart(reinterpret_cast<const unsigned char*>(raw.data()),
+                                        raw.size(), &json_len, &error_code);
+    if (!json_data) {
+        fprintf(stderr, "PEZ 解包失败 (%d): %s\n", error_code, path.c_str());
+        return false;
+    }
+    chart.assign(json_data, json_len);
+    free(json_data);
+    return true;
+}
+
+static int run_parse(const std::vector<std::string>& files) {
+    if (files.empty()) {
+        print_usage();
+        return 1;
+    }
+    int status = 0;
+    for (const auto& path : files) {
+        std::string chart;
+        if (!load_chart_file(path, chart)) {
+            status = 1;
+            continue;
+        }
+        ParseResult res = parse_single_json(chart.data(), chart.size());
+        printf("%s\n", result_to_json(res).c_str());
+        if (res.error_code != 0) status = 1;
+    }
+    return status;
+}
+
+static int run_merge(const std::string& form_path, const std::string& output_path,
+                     int indent, unsigned threads, size_t budget, const std::string& base_pez_path,
+                     const std::vector<std::string>& files) {
+    if (form_path.empty()) {
+        print_usage();
+        return 1;
+    }
+
+    std::string form_str;
+    if (!read_file(form_path, form_str)) {
+        fprintf(stderr, "无法读取表单: %s\n", form_path.c_str());
+        return 1;
+    }
+    PerfScope form_scope(PerfPhase::FormParse, form_str.size());
+    json form = json::parse(form_str, nullptr, false);
+    form_scope.stop();
+    if (form.is_discarded() || !form.is_object()) {
+        fprintf(stderr, "表单不是合法的 JSON 对象: %s\n", form_path.c_str());
+        return 1;
+    }
+    form_str.clear();
+
+    /* 依次为没有 chartJson 的卡片载入命令行给出的谱面，解析结果登记为新的句柄并写回卡片的 handle
+     * 网页保存的表单里每张卡片都带着页面当时的 handle，在这里没有意义，一律覆盖
+     */
+    ChartCache cache(budget);
+    size_t next_file = 0;
+    if (form.contains("cards") && form["cards"].is_array()) {
+        for (auto& card : form["cards"]) {
+            if (!card.is_object() || card.contains("chartJson")) continue;
+            if (next_file >= files.size()) {
+                fprintf(stderr, "谱面文件数量少于表单中的卡片数量\n");
+                return 1;
+            }
+            const std::string& path = files[next_file++];
+
+            // PEZ 边解压边解析，不先解出完整的谱面 JSON
+            std::string raw;
+            if (!read_file(path, raw)) {
+                fprintf(stderr, "无法读取文件: %s\n", path.c_str());
+                return 1;
+            }
+            ParseResult stats;
+            std::shared_ptr<ParsedChart> parsed = ends_with(path, ".pez")
+                ? parse_pez_chart(reinterpret_cast<const unsigned char*>(raw.data()), raw.size(), stats)
+                : parse_chart(raw.data(), raw.size(), stats);
+            if (!parsed) {
+                fprintf(stderr, "谱面解析失败 (%d): %s\n", stats.error_code, path.c_str());
+                return 1;
+            }
+            card["handle"] = cache.add(std::move(parsed));
+        }
+    }
+    if (next_file < files.size()) {
+        fprintf(stderr, "警告: 有 %zu 个谱面文件未被表单使用\n", files.size() - next_file);
+    }
+
+    OutputBuffer out;
+    if (!merge_to_buffer(std::move(form), &cache, indent, out, threads)) {
+        if (out.failed()) {
+            fprintf(stderr, "合并失败: 内存不足\n");
+        } else {
+            fprintf(stderr, "合并失败: %.*s\n", static_cast<int>(out.size()), out.data());
+        }
+        return 1;
+    }
+
+    // 需要打包时改为写出新的 PEZ
+    if (!base_pez_path.empty()) {
+        std::string base_pez;
+        if (!read_file(base_pez_path, base_pez)) {
+            fprintf(stderr, "无法读取文件: %s\n", base_pez_path.c_str());
+            return 1;
+        }
+        OutputBuffer pez;
+        int error_code = write_merged_pez(reinterpret_cast<const unsigned char*>(base_pez.data()),
+                                          base_pez.size(), out.data(), out.size(), pez);
+        if (error_code != PEZ_OK) {
+            fprintf(stderr, "PEZ 打包失败 (%d): %s\n", error_code, base_pez_path.c_str());
+            return 1;
+        }
+        out.swap(pez);
+    }
+
+    FILE* fp = output_path.empty() ? stdout : fopen(output_path.c_str(), "wb");
+    if (!fp) {
+        fprintf(stderr, "无法写入文件: %s\n", output_path.c_str());
+        return 1;
+    }
+    bool ok = fwrite(out.data(), 1, out.size(), fp) == out.size();
+    if (fp != stdout) fclose(fp);
+    if (!ok) {
+        fprintf(stderr, "写入失败: %s\n", output_path.c_str());
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        print_usage();
+        return 1;
+    }
+
+    std::string command = argv[1];
+    std::string form_path;
+    std::string output_path;
+    std::string base_pez_path;
+    int indent = 3;
+    int threads = 0;
+    size_t budget_mb = 0;
+    bool stats = false;
+    std::vector<std::string> files;
+
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if ((arg == "-f" || arg == "--form") && i + 1 < argc) {
+            form_path = argv[++i];
+        } else if ((arg == "-o" || arg == "--output") && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if (arg == "--stats") {
+            stats = true;
+        } else if (arg == "--pez" && i + 1 < argc) {
+            base_pez_path = argv[++i];
+        } else if (arg == "--indent" && i + 1 < argc) {
+            indent = atoi(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threads = std::max(0, atoi(argv[++i]));
+        } else if (arg == "--budget" && i + 1 < argc) {
+            budget_mb = static_cast<size_t>(std::max(0, atoi(argv[++i])));
+        } else if (arg == "-h" || arg == "--help") {
+            print_usage();
+            return 0;
+        } else if (!arg.empty() && arg[0] == '-') {
+            fprintf(stderr, "未知参数: %s\n", arg.c_str());
+            print_usage();
+            return 1;
+        } else {
+            files.push_back(arg);
+        }
+    }
+
+    int status;
+    if (command == "parse") {
+        status = run_parse(files);
+    } else if (command == "merge") {
+        status = run_merge(form_path, output_path, indent, static_cast<unsigned>(threads),
+                            budget_mb * 1024 * 1024, base_pez_path, files);
+    } else {
+        print_usage();
+        return 1;
+    }
+    if (stats) {
+        fprintf(stderr, "%s\n", perf_report_json().c_str());
+    }
+    return status;
+}
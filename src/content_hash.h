@@ -0,0 +1,10 @@
+#pragma once
+
+/* 输入字节的内容哈希（xxHash64）
+ * 用于识别重复载入的谱面：同一份文件再次拖入时直接复用已解析的结果。
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+uint64_t xxhash64(const void* data, size_t len, uint64_t seed = 0);
@@ -0,0 +1,336 @@
+#pragma once
+
+/* 就地解析整块 JSON 的 SAX 解析器
+ * 输入已经完整地放在一块连续内存里时（载入的谱面、表单里的 chartJson），直接在输入上扫描：
+ * 键与字符串以 std::string_view 交给处理器，不含转义时指向输入本身（谱面中几乎都是这种），
+ * 含转义时才解码到内部的缓冲区；数字经 json_number.h 的快速路径转换，不再逐个 strtod。
+ * 回调与 nlohmann 的 SAX 约定相同（key / string 的参数为 std::string_view），
+ * 语法也与 nlohmann 默认设置一致：严格 JSON，可以带 UTF-8 BOM，字符串必须是合法的 UTF-8，
+ * 顶层值之后只能有空白。
+ *
+ * 解析失败时不调用 parse_error；调用者应当丢弃处理器的状态，改用 nlohmann 再解析一遍（见 sax_parse_json），
+ * 以 nlohmann 的结果为准，错误的判定与原先完全相同。
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "chart_core.h"
+#include "json_number.h"
+
+template <typename Sax>
+class JsonInsituParser {
+public:
+    JsonInsituParser(const char* begin, const char* end, Sax& sax) : p_(begin), end_(end), sax_(sax) {}
+
+    // 解析整份文档，格式错误或处理器返回 false 时返回 false
+    bool parse() {
+        if (end_ - p_ >= 3 && static_cast<unsigned char>(p_[0]) == 0xEF) {
+            if (static_cast<unsigned char>(p_[1]) != 0xBB || static_cast<unsigned char>(p_[2]) != 0xBF) return false;
+            p_ += 3;
+        }
+        for (;;) {
+            if (!value()) return false;
+            // 一个值结束：逗号之后是下一个值，右括号结束所在的容器
+            for (;;) {
+                skip_space();
+                if (containers_.empty()) return p_ == end_;
+                if (p_ == end_) return false;
+                char c = *p_++;
+                char open = containers_.back();
+                if (c == ',') {
+                    if (open == '{' && !key()) return false;
+                    break;
+                }
+                if (c != (open == '{' ? '}' : ']')) return false;
+                containers_.pop_back();
+                if (!(open == '{' ? sax_.end_object() : sax_.end_array())) return false;
+            }
+        }
+    }
+
+private:
+    const char* p_;
+    const char* end_;
+    Sax& sax_;
+    std::vector<char> containers_;   // '{' 或 '['
+    std::string scratch_;            // 含转义的字符串解码到这里
+
+    void skip_space() {
+        while (p_ < end_ && (*p_ == ' ' || *p_ == '\n' || *p_ == '\r' || *p_ == '\t')) ++p_;
+    }
+
+    // 读取一个值；遇到非空的容器时只读入开头（以及对象的第一个键），其余由 parse 的循环继续
+    bool value() {
+        for (;;) {
+            skip_space();
+            if (p_ == end_) return false;
+            switch (*p_) {
+                case '{':
+                    ++p_;
+                    if (!sax_.start_object(static_cast<std::size_t>(-1))) return false;
+                    skip_space();
+                    if (p_ < end_ && *p_ == '}') {
+                        ++p_;
+                        return sax_.end_object();
+                    }
+                    containers_.push_back('{');
+                    if (!key()) return false;
+                    continue;
+                case '[':
+                    ++p_;
+                    if (!sax_.start_array(static_cast<std::size_t>(-1))) return false;
+                    skip_space();
+                    if (p_ < end_ && *p_ == ']') {
+                        ++p_;
+                        return sax_.end_array();
+                    }
+                    containers_.push_back('[');
+                    continue;
+                case '"': {
+                    std::string_view s;
+                    return string(s) && sax_.string(s);
+                }
+                case 't': return literal("true", 4) && sax_.boolean(true);
+                case 'f': return literal("false", 5) && sax_.boolean(false);
+                case 'n': return literal("null", 4) && sax_.null();
+                default:  return number();
+            }
+        }
+    }
+
+    // 读取对象中的键与其后的冒号
+    bool key() {
+        skip_space();
+        if (p_ == end_ || *p_ != '"') return false;
+        std::string_view s;
+        if (!string(s) || !sax_.key(s)) return false;
+        skip_space();
+        if (p_ == end_ || *p_ != ':') return false;
+        ++p_;
+        return true;
+    }
+
+    bool literal(const char* text, size_t len) {
+        if (static_cast<size_t>(end_ - p_) < len || memcmp(p_, text, len) != 0) return false;
+        p_ += len;
+        return true;
+    }
+
+    bool number() {
+        const char* begin = p_;
+        bool is_float = false;
+        if (*p_ == '-') ++p_;
+        if (p_ == end_) return false;
+        if (*p_ == '0') {
+            ++p_;
+        } else if (is_digit(*p_)) {
+            while (p_ < end_ && is_digit(*p_)) ++p_;
+        } else {
+            return false;
+        }
+        if (p_ < end_ && *p_ == '.') {
+            ++p_;
+            if (p_ == end_ || !is_digit(*p_)) return false;
+            while (p_ < end_ && is_digit(*p_)) ++p_;
+            is_float = true;
+        }
+        if (p_ < end_ && (*p_ == 'e' || *p_ == 'E')) {
+            ++p_;
+            if (p_ < end_ && (*p_ == '+' || *p_ == '-')) ++p_;
+            if (p_ == end_ || !is_digit(*p_)) return false;
+            while (p_ < end_ && is_digit(*p_)) ++p_;
+            is_float = true;
+        }
+
+        JsonNumber number;
+        if (!parse_json_number(begin, p_, is_float, number)) return false;
+        switch (number.kind) {
+            case JsonNumber::Kind::Integer:  return sax_.number_integer(number.integer);
+            case JsonNumber::Kind::Unsigned: return sax_.number_unsigned(number.unsigned_integer);
+            case JsonNumber::Kind::Float:
+                return sax_.number_float(number.number_float, std::string_view(begin, p_ - begin));
+        }
+        return false;
+    }
+
+    static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+    // 8 个字节中是否有引号、反斜杠、控制字符或非 ASCII 字节
+    static bool has_special_byte(uint64_t w) {
+        const uint64_t ones = 0x0101010101010101ull;
+        const uint64_t highs = 0x8080808080808080ull;
+        uint64_t quote = w ^ (ones * '"');
+        uint64_t backslash = w ^ (ones * '\\');
+        uint64_t special = ((quote - ones) & ~quote) | ((backslash - ones) & ~backslash) |
+                           (w - ones * 0x20) | w;
+        return (special & highs) != 0;
+    }
+
+    // p_ 指向开头的引号；读到结尾的引号之后
+    bool string(std::string_view& out) {
+        const char* start = ++p_;
+        while (end_ - p_ >= 8) {
+            uint64_t w;
+            memcpy(&w, p_, sizeof(w));
+            if (has_special_byte(w)) break;
+            p_ += 8;
+        }
+        // 不含转义的字符串直接引用输入
+        while (p_ < end_) {
+            unsigned char c = static_cast<unsigned char>(*p_);
+            if (c == '"') {
+                out = std::string_view(start, p_ - start);
+                ++p_;
+                return true;
+            }
+            if (c == '\\') break;
+            if (c < 0x20) return false;
+            if (c >= 0x80) {
+                if (!utf8_sequence()) return false;
+            } else {
+                ++p_;
+            }
+        }
+        if (p_ == end_) return false;
+
+        // 含转义：已经扫过的部分原样放进缓冲区，之后逐个解码
+        scratch_.assign(start, p_ - start);
+        while (p_ < end_) {
+            unsigned char c = static_cast<unsigned char>(*p_);
+            if (c == '"') {
+                out = scratch_;
+                ++p_;
+                return true;
+            }
+            if (c == '\\') {
+                if (!escape()) return false;
+            } else if (c < 0x20) {
+                return false;
+            } else if (c >= 0x80) {
+                const char* seq = p_;
+                if (!utf8_sequence()) return false;
+                scratch_.append(seq, p_ - seq);
+            } else {
+                scratch_.push_back(static_cast<char>(c));
+                ++p_;
+            }
+        }
+        return false;
+    }
+
+    // 校验并跳过一个多字节的 UTF-8 序列（拒绝过长编码、代理项与超出 U+10FFFF 的码点）
+    bool utf8_sequence() {
+        unsigned char c = static_cast<unsigned char>(*p_++);
+        int remaining;
+        unsigned char lo = 0x80, hi = 0xBF;
+        if (c >= 0xC2 && c <= 0xDF) {
+            remaining = 1;
+        } else if (c >= 0xE0 && c <= 0xEF) {
+            remaining = 2;
+            if (c == 0xE0) lo = 0xA0;
+            if (c == 0xED) hi = 0x9F;
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            remaining = 3;
+            if (c == 0xF0) lo = 0x90;
+            if (c == 0xF4) hi = 0x8F;
+        } else {
+            return false;
+        }
+        for (; remaining > 0; --remaining, lo = 0x80, hi = 0xBF) {
+            if (p_ == end_) return false;
+            unsigned char b = static_cast<unsigned char>(*p_++);
+            if (b < lo || b > hi) return false;
+        }
+        return true;
+    }
+
+    static int hex_value(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    // 读取 \u 之后的 4 位十六进制数
+    bool hex4(uint32_t& value) {
+        if (end_ - p_ < 4) return false;
+        value = 0;
+        for (int i = 0; i < 4; ++i) {
+            int digit = hex_value(*p_++);
+            if (digit < 0) return false;
+            value = (value << 4) | static_cast<uint32_t>(digit);
+        }
+        return true;
+    }
+
+    // p_ 指向反斜杠
+    bool escape() {
+        if (end_ - p_ < 2) return false;
+        char c = p_[1];
+        p_ += 2;
+        switch (c) {
+            case '"':  scratch_.push_back('"'); return true;
+            case '\\': scratch_.push_back('\\'); return true;
+            case '/':  scratch_.push_back('/'); return true;
+            case 'b':  scratch_.push_back('\b'); return true;
+            case 'f':  scratch_.push_back('\f'); return true;
+            case 'n':  scratch_.push_back('\n'); return true;
+            case 'r':  scratch_.push_back('\r'); return true;
+            case 't':  scratch_.push_back('\t'); return true;
+            case 'u':  break;
+            default:   return false;
+        }
+
+        uint32_t cp;
+        if (!hex4(cp)) return false;
+        if (cp >= 0xDC00 && cp <= 0xDFFF) return false;
+        if (cp >= 0xD800 && cp <= 0xDBFF) {
+            // 高代理项之后必须紧跟低代理项
+            uint32_t low;
+            if (end_ - p_ < 2 || p_[0] != '\\' || p_[1] != 'u') return false;
+            p_ += 2;
+            if (!hex4(low) || low < 0xDC00 || low > 0xDFFF) return false;
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+        }
+        append_utf8(cp);
+        return true;
+    }
+
+    void append_utf8(uint32_t cp) {
+        if (cp < 0x80) {
+            scratch_.push_back(static_cast<char>(cp));
+        } else if (cp < 0x800) {
+            scratch_.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+            scratch_.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        } else if (cp < 0x10000) {
+            scratch_.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+            scratch_.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            scratch_.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        } else {
+            scratch_.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+            scratch_.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+            scratch_.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            scratch_.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        }
+    }
+};
+
+template <typename Sax>
+bool insitu_sax_parse(const char* begin, const char* end, Sax& sax) {
+    return JsonInsituParser<Sax>(begin, end, sax).parse();
+}
+
+// 依次尝试的解析器：先就地解析，失败时以 nlohmann 重新解析
+enum class JsonBackend { Insitu, Nlohmann };
+constexpr JsonBackend JSON_BACKENDS[] = {JsonBackend::Insitu, JsonBackend::Nlohmann};
+
+template <typename Sax>
+bool sax_parse_json(JsonBackend backend, const char* begin, const char* end, Sax& sax) {
+    if (backend == JsonBackend::Insitu) return insitu_sax_parse(begin, end, sax);
+    return json::sax_parse(begin, end, &sax);
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+/* JSON 数字的快速转换
+ * 整数逐位累加，不经过 strtoll / strtoull；浮点数在有效数字不超过 19 位、可以用 double 精确表示
+ * 且十进制指数在 ±22 以内时（谱面中的时间、坐标几乎都是这种），以一次精确的乘除得到结果，
+ * 与正确舍入的 strtod 相同（Clinger 快速路径）；其余情况仍交给 strtod。
+ * 整数/无符号/浮点的划分与 nlohmann 一致：负整数为 integer，非负整数为 unsigned，放不下时退回浮点数。
+ */
+
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+struct JsonNumber {
+    enum class Kind { Integer, Unsigned, Float };
+    Kind kind = Kind::Unsigned;
+    int64_t integer = 0;
+    uint64_t unsigned_integer = 0;
+    double number_float = 0.0;
+};
+
+// x87 等以扩展精度计算的平台上，快速路径的一次乘除不保证正确舍入，只用 strtod
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+constexpr bool JSON_FAST_FLOAT = true;
+#else
+constexpr bool JSON_FAST_FLOAT = false;
+#endif
+
+inline double json_strtod(const char* begin, const char* end) {
+    // strtod 需要以 '\0' 结尾；数字 token 一般很短，放在栈上
+    char buffer[64];
+    size_t len = static_cast<size_t>(end - begin);
+    if (len < sizeof(buffer)) {
+        for (size_t i = 0; i < len; ++i) buffer[i] = begin[i];
+        buffer[len] = '\0';
+        return std::strtod(buffer, nullptr);
+    }
+    return std::strtod(std::string(begin, len).c_str(), nullptr);
+}
+
+/* 转换 [begin, end) 中的数字，token 必须已经符合 JSON 数字的语法
+ * is_float 表示 token 中有小数点或指数；结果不是有限值时（如 1e400）返回 false，nlohmann 同样视为错误
+ */
+inline bool parse_json_number(const char* begin, const char* end, bool is_float, JsonNumber& out) {
+    const char* p = begin;
+    bool negative = *p == '-';
+    if (negative) ++p;
+
+    if (!is_float) {
+        uint64_t value = 0;
+        bool overflow = false;
+        for (; p < end; ++p) {
+            unsigned digit = static_cast<unsigned>(*p - '0');
+            if (value > (UINT64_MAX - digit) / 10) {
+                overflow = true;
+                break;
+            }
+            value = value * 10 + digit;
+        }
+        if (!overflow && !negative) {
+            out.kind = JsonNumber::Kind::Unsigned;
+            out.unsigned_integer = value;
+            return true;
+        }
+        if (!overflow && value <= static_cast<uint64_t>(INT64_MAX) + 1) {
+            out.kind = JsonNumber::Kind::Integer;
+            out.integer = value == static_cast<uint64_t>(INT64_MAX) + 1 ? INT64_MIN : -static_cast<int64_t>(value);
+            return true;
+        }
+        // 整数放不下时按浮点数处理
+    } else if (JSON_FAST_FLOAT) {
+        static const double POW10[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+        uint64_t mantissa = 0;
+        int significant = 0;   // 有效数字的位数，不含前导零
+        int exponent = 0;
+        bool in_fraction = false;
+        for (; p < end; ++p) {
+            char c = *p;
+            if (c == '.') {
+                in_fraction = true;
+                continue;
+            }
+            if (c == 'e' || c == 'E') break;
+            unsigned digit = static_cast<unsigned>(c - '0');
+            if (in_fraction) --exponent;
+            if (mantissa == 0 && digit == 0) continue;
+            if (++significant > 19) break;
+            mantissa = mantissa * 10 + digit;
+        }
+        if (significant <= 19) {
+            if (p < end && (*p == 'e' || *p == 'E')) {
+                ++p;
+                bool exp_negative = *p == '-';
+                if (*p == '-' || *p == '+') ++p;
+                int value = 0;
+                for (; p < end; ++p) {
+                    if (value < 100000) value = value * 10 + (*p - '0');
+                }
+                exponent += exp_negative ? -value : value;
+            }
+            if (mantissa == 0 || (mantissa <= (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22)) {
+                double value = static_cast<double>(mantissa);
+                if (mantissa != 0) value = exponent >= 0 ? value * POW10[exponent] : value / POW10[-exponent];
+                out.kind = JsonNumber::Kind::Float;
+                out.number_float = negative ? -value : value;
+                return true;
+            }
+        }
+    }
+
+    out.kind = JsonNumber::Kind::Float;
+    out.number_float = json_strtod(begin, end);
+    return std::isfinite(out.number_float);
+}
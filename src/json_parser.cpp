@@ -1,613 +1,494 @@
+/* WebAssembly 导出层
+ * 只负责与前端之间的数据交接，解析与合并的逻辑都在 chart_core 中。
+ */
+
 #include <string>
+#include <algorithm>
 #include <cstring>
+#include <cstdlib>
 #include <vector>
+#include <map>
+#include <memory>
 #include <mutex>
-#include <algorithm>
+#ifdef __EMSCRIPTEN__
 #include <emscripten.h>
+#endif
 
-#include "../include/nlohmann/json.hpp"
-#include "../include/miniz/miniz.h"
+#include "chart_core.h"
+#include "chart_cache.h"
+#include "chart_snapshot.h"
+#include "chart_store.h"
+#include "content_hash.h"
+#include "json_push_parser.h"
+#include "json_writer.h"
+#include "pez_archive.h"
+#include "perf.h"
 
-using json = nlohmann::json;
+// 已解析谱面常驻内存的默认预算，超出后最久未用的谱面换出为压缩的紧凑形式
+static const size_t DEFAULT_CHART_BUDGET = 512u * 1024 * 1024;
 
-struct JudgeLineStats {
-    int event_count;  // 该判定线的事件总数
-    int special_event_count;    // 该判定线的特殊事件总数
-    int note_count;   // 该判定线的音符总数
-};
+// 载入时解析好的谱面，以句柄登记，合并时按句柄复用
+static ChartCache chart_cache(DEFAULT_CHART_BUDGET);
 
-struct TimeSignature {
-    int measure;
-    int numerator;
-    int denominator;
-};
+// 以 PEZ 载入的谱面保留原包（按句柄），导出 PEZ 时直接复制其中的资源条目
+static std::map<int, std::shared_ptr<PezArchive>> pez_sources;
 
-struct JudgeLineConfig {
-    TimeSignature startTime;
-    TimeSignature endTime;
-    bool copyEvents;
-    bool copyNotes;
-};
+extern "C" const char* parse_json(const char* json_str, size_t json_len) {
+    static std::string result_str;
+    // 已经载入过同样的内容时直接用当时的统计信息
+    ParseResult res;
+    if (!chart_cache.find_hash(xxhash64(json_str, json_len), &res)) {
+        res = parse_single_json(json_str, json_len);
+    }
+    result_str = result_to_json(res);
+    return result_str.c_str();
+}
 
-struct ParseResult {
-    // std::string raw_json;
-    // 我去，直接传输一个 40MB 的源文件吗，小心内存爆炸
+// 统计信息加上登记的句柄，解析失败时句柄为 0
+static std::string load_result(const ParseResult& res, int handle) {
+    json result = result_to_object(res);
+    result["handle"] = handle;
+    return result.dump();
+}
 
-    int bpm_count;
-    double min_bpm;
-    double max_bpm;
-    int rpe_version;
-    std::string charter;
-    std::string composer;
-    std::string id;
-    std::string level;
-    std::string name;
+// 同样的内容已经登记过时直接共享，否则解析并登记；解析失败时返回 0
+static int register_chart(const char* json_str, size_t json_len, ParseResult& res) {
+    uint64_t hash = xxhash64(json_str, json_len);
+    int handle = chart_cache.share(hash, res);
+    if (!handle) {
+        std::shared_ptr<ParsedChart> chart = parse_chart(json_str, json_len, res);
+        if (chart) handle = chart_cache.add(std::move(chart), hash, res);
+    }
+    return handle;
+}
 
-    int judge_line_count;
-    std::vector<JudgeLineStats> judge_line_stats;
+/* 解析谱面并登记，返回值在 parse_json 的基础上多出 handle
+ * 之后合并表单中的卡片以 handle 引用这份谱面，不必带上 chartJson。
+ * 同样的内容已经载入过时不再解析，新句柄与之共享同一份谱面。
+ */
+extern "C" const char* load_chart(const char* json_str, size_t json_len) {
+    static std::string result_str;
+    ParseResult res;
+    int handle = register_chart(json_str, json_len, res);
+    result_str = load_result(res, handle);
+    return result_str.c_str();
+}
 
-    int error_code;
-};
+/* 前端存进 IndexedDB 的谱面：u64 原始长度（小端）+ zlib 流
+ * RPE JSON 重复很多，级别 3 压缩约 8 倍，速度比默认级别快一倍多，载入时顺带压缩不会明显变慢。
+ */
+static const int DEFLATE_CHART_LEVEL = 3;
+static OutputBuffer deflated_result;
 
-bool has_start_end_time(const json& obj) {
-    return obj.contains("startTime") && obj["startTime"].is_array() 
-        && obj.contains("endTime") && obj["endTime"].is_array();
+static mz_bool append_deflated(const void* buf, int len, void* user) {
+    OutputBuffer& out = *static_cast<OutputBuffer*>(user);
+    out.append(static_cast<const char*>(buf), static_cast<size_t>(len));
+    return !out.failed();
 }
 
-ParseResult parse_single_json(const char* json_str, size_t json_len) {
-    ParseResult result = {
-        0, 0.0, 0.0, 0, "", "", "", "", "", 
-        0, {},
-        -1};
-    if (!json_str || json_len == 0) {
-        result.error_code = -2;
-        return result;
+/* 压缩谱面 JSON，结果通过 deflated_size / deflated_data 读取
+ * 返回 0 表示成功，-3 表示内存不足
+ */
+extern "C" int deflate_chart(const char* json_str, size_t json_len) {
+    deflated_result.clear();
+    uint64_t original_len = json_len;
+    deflated_result.append(reinterpret_cast<const char*>(&original_len), sizeof(original_len));
+    mz_uint flags = tdefl_create_comp_flags_from_zip_params(DEFLATE_CHART_LEVEL, MZ_DEFAULT_WINDOW_BITS,
+                                                            MZ_DEFAULT_STRATEGY);
+    if (!tdefl_compress_mem_to_output(json_str, json_len, append_deflated, &deflated_result, flags) ||
+        deflated_result.failed()) {
+        deflated_result.clear();
+        return -3;
     }
+    return 0;
+}
 
-    // result.raw_json = std::string(json_str, json_len);
-    json j = json::parse(json_str, json_str + json_len);
-    
-    // 处理 BPMList
-    if (j.contains("BPMList") && j["BPMList"].is_array()) {
-        auto& bpm_list = j["BPMList"];
-        result.bpm_count = bpm_list.size();
-           
-        if (result.bpm_count > 0) {
-            std::vector<double> bpms;
-            for (auto& item : bpm_list) {
-                if (item.contains("bpm") && item["bpm"].is_number()) {
-                    bpms.push_back(item["bpm"].get<double>());
-                }
-            }
-            if (!bpms.empty()) {
-                result.min_bpm = *std::min_element(bpms.begin(), bpms.end());
-                result.max_bpm = *std::max_element(bpms.begin(), bpms.end());
-            }
-        }
+extern "C" size_t deflated_size() {
+    return deflated_result.size();
+}
+
+extern "C" const char* deflated_data() {
+    return deflated_result.data();
+}
+
+extern "C" void release_deflated() {
+    deflated_result.clear();
+}
+
+/* 载入 deflate_chart 压缩过的谱面，返回值与 load_chart 相同
+ * 在模块内解压到堆上直接解析，前端不必先解压、也不经过 JS 字符串。
+ * 数据损坏或内存不足时 error 为 PEZ_EXTRACT_FAILED。
+ */
+extern "C" const char* load_deflated_chart(const unsigned char* data, size_t size) {
+    static std::string result_str;
+    ParseResult res;
+    int handle = 0;
+    uint64_t json_len = 0;
+    char* json_str = nullptr;
+    if (size >= sizeof(json_len)) {
+        memcpy(&json_len, data, sizeof(json_len));
+        // deflate 的压缩比不会超过约 1032:1，借此挡住损坏的长度
+        if (json_len < static_cast<mz_ulong>(-1) && json_len / 1032 <= size) json_str = static_cast<char*>(malloc(json_len + 1));
     }
-        
-    // 处理 META
-    if (j.contains("META") && j["META"].is_object()) {
-        auto& meta = j["META"];
-        if (meta.contains("RPEVersion") && meta["RPEVersion"].is_number()) {
-            result.rpe_version = meta["RPEVersion"].get<int>();
-        }
-        if (meta.contains("charter") && meta["charter"].is_string()) {
-            result.charter = meta["charter"].get<std::string>();
-        }
-        if (meta.contains("composer") && meta["composer"].is_string()) {
-            result.composer = meta["composer"].get<std::string>();
-        }
-        if (meta.contains("id") && meta["id"].is_string()) {
-            result.id = meta["id"].get<std::string>();
-        }
-        if (meta.contains("level") && meta["level"].is_string()) {
-            result.level = meta["level"].get<std::string>();
-        }
-        if (meta.contains("name") && meta["name"].is_string()) {
-            result.name = meta["name"].get<std::string>();
-        }
+    mz_ulong out_len = static_cast<mz_ulong>(json_len);
+    if (json_str && mz_uncompress(reinterpret_cast<unsigned char*>(json_str), &out_len, data + sizeof(json_len),
+                                  static_cast<mz_ulong>(size - sizeof(json_len))) == MZ_OK &&
+        out_len == json_len) {
+        json_str[json_len] = '\0';
+        handle = register_chart(json_str, json_len, res);
+    } else {
+        res = ParseResult();
+        res.error_code = PEZ_EXTRACT_FAILED;
     }
+    free(json_str);
+    result_str = load_result(res, handle);
+    return result_str.c_str();
+}
 
-    // 处理判定线数量（judgeLineList 数组长度）
-    if (j.contains("judgeLineList") && j["judgeLineList"].is_array()) {
-        auto& judge_lines = j["judgeLineList"];
-        result.judge_line_count = judge_lines.size();
-        result.judge_line_stats.reserve(result.judge_line_count);
-
-        // 遍历每个判定线，单独统计
-        for (auto& line : judge_lines) {
-            JudgeLineStats stats = {0, 0};  // 初始化当前判定线的计数为 0
-
-            // 处理当前判定线的 eventLayers 事件
-            if (line.contains("eventLayers") && line["eventLayers"].is_array()) {
-                for (auto& layer : line["eventLayers"]) {
-                    // 遍历 eventLayers 中的集合
-                    const std::vector<std::string> event_arrays = {
-                        "alphaEvents",
-                        "moveXEvents",
-                        "moveYEvents",
-                        "rotateEvents",
-                        "speedEvents"
-                    };
-                    for (const auto& arr_name : event_arrays) {
-                        if (layer.contains(arr_name) && layer[arr_name].is_array()) {
-                            for (auto& event : layer[arr_name]) {
-                                // 遍历数组中的事件
-                                if (has_start_end_time(event)) {
-                                    stats.event_count++;
-                                }
-                            }
-                        }
-                    }
-                }
-            }
+// 内容哈希相同的谱面已经以 PEZ 载入时，返回当时保留的原包
+static std::shared_ptr<PezArchive> pez_source_by_hash(uint64_t hash) {
+    for (auto& [handle, pez] : pez_sources) {
+        uint64_t source_hash = 0;
+        if (chart_cache.hash_of(handle, source_hash) && source_hash == hash) return pez;
+    }
+    return nullptr;
+}
 
-            // 处理当前判定线的 extended 事件
-            if (line.contains("extended") && line["extended"].is_object()) {
-                auto& extended = line["extended"];
-                // 遍历 extended 中所有数组（不限制键名）
-                for (auto& [key, arr] : extended.items()) {
-                    if (arr.is_array()) {
-                        for (auto& event : arr) {
-                            // 遍历数组中的事件
-                            if (has_start_end_time(event)) {
-                                stats.special_event_count++;
-    /* 并不知道这个东西是什么，是不是故事板？
-     * 但是它毕竟是事件，所以我也检测了，如果要用也可以用。
-     */
-                            }
-                        }
-                    }
-                }
-            }
+/* 从 PEZ 中边解压边解析谱面并登记，返回值与 load_chart 相同
+ * 谱面 JSON 不再解压成完整的字符串交给前端，再由前端复制回来解析。
+ * pez_data 须由 _malloc 分配，调用后归模块所有：解析成功时原包随句柄保留，
+ * 直到 release_chart，前端不要再 free。
+ */
+extern "C" const char* load_pez(const unsigned char* pez_data, size_t data_size) {
+    static std::string result_str;
+    ParseResult res;
+    uint64_t hash = xxhash64(pez_data, data_size);
+    int handle = chart_cache.share(hash, res);
+    std::shared_ptr<PezArchive> pez = handle ? pez_source_by_hash(hash) : nullptr;
+    if (pez) {
+        // 同样的原包已经保留了一份，这份不再需要
+        free(const_cast<unsigned char*>(pez_data));
+    } else {
+        pez = std::make_shared<PezArchive>(pez_data, data_size, true);
+    }
+    if (!handle) {
+        std::shared_ptr<ParsedChart> chart = parse_pez_chart(*pez, res);
+        if (chart) handle = chart_cache.add(std::move(chart), hash, res);
+    }
+    if (handle) pez_sources[handle] = std::move(pez);
+    result_str = load_result(res, handle);
+    return result_str.c_str();
+}
 
-            // 处理当前判定线的 notes
-            if (line.contains("notes") && line["notes"].is_array()) {
-                for (auto& note : line["notes"]) {
-                    // 遍历每个音符
-                    if (has_start_end_time(note)) {
-                        stats.note_count++;
-                    }
-                }
-            }
+/* 把已经登记的句柄与 PEZ 原包关联，用于由快照恢复的 PEZ 卡片（快照里不含原包）
+ * pez_data 的所有权与 load_pez 相同：调用后归模块所有，句柄不存在时立即释放。
+ */
+extern "C" void attach_pez(int handle, const unsigned char* pez_data, size_t data_size) {
+    if (!chart_cache.contains(handle)) {
+        free(const_cast<unsigned char*>(pez_data));
+        return;
+    }
+    pez_sources[handle] = std::make_shared<PezArchive>(pez_data, data_size, true);
+}
 
-            // 将当前判定线的统计结果存入 vector
-            result.judge_line_stats.push_back(stats);
-        }
-    } else {
-        result.judge_line_count = 0;
+static OutputBuffer snapshot_result;
+
+/* 为句柄对应的谱面生成快照，结果通过 snapshot_size / snapshot_data 读取
+ * 返回 0 表示成功，-1 表示句柄不存在或没有记下统计信息，-3 表示内存不足
+ */
+extern "C" int make_chart_snapshot(int handle) {
+    snapshot_result.clear();
+    PerfScope scope(PerfPhase::Snapshot);
+    ParseResult stats;
+    uint64_t hash = 0;
+    if (!chart_cache.stats_of(handle, stats)) return -1;
+    bool has_hash = chart_cache.hash_of(handle, hash);
+    std::shared_ptr<const ParsedChart> chart = chart_cache.find(handle);
+    if (!chart) return -3;
+    if (!write_chart_snapshot(*chart, stats, has_hash, hash, snapshot_result)) {
+        snapshot_result.clear();
+        return -3;
     }
+    scope.add_bytes(snapshot_result.size());
+    return 0;
+}
+
+extern "C" size_t snapshot_size() {
+    return snapshot_result.size();
+}
 
-    result.error_code = 0;
-    return result;
-}
-
-std::string result_to_json(const ParseResult& res) {
-    json j;
-    // j["raw_json"] = res.raw_json;
-
-    j["bpm_count"] = res.bpm_count;
-    j["min_bpm"] = res.min_bpm;
-    j["max_bpm"] = res.max_bpm;
-    j["rpe_version"] = res.rpe_version;
-    j["charter"] = res.charter;
-    j["composer"] = res.composer;
-    j["id"] = res.id;
-    j["level"] = res.level;
-    j["name"] = res.name;
-
-    j["judge_line_count"] = res.judge_line_count;
-    // 转换每个判定线的统计数据为 JSON 数组
-    json judge_line_stats_json = json::array();
-    for (const auto& stats : res.judge_line_stats) {
-        judge_line_stats_json.push_back({
-            {"event_count", stats.event_count},
-            {"special_event_count", stats.special_event_count},
-            {"note_count", stats.note_count}
-        });
+extern "C" const char* snapshot_data() {
+    return snapshot_result.data();
+}
+
+extern "C" void release_snapshot() {
+    snapshot_result.clear();
+}
+
+/* 由快照恢复谱面并登记，返回值与 load_chart 相同
+ * 快照记下的内容哈希已经登记过时直接共享那份谱面；快照无效时 error 为 SNAPSHOT_INVALID、handle 为 0。
+ */
+extern "C" const char* load_chart_snapshot(const unsigned char* data, size_t size) {
+    static std::string result_str;
+    PerfScope scope(PerfPhase::Restore);
+    scope.add_bytes(size);
+    ParseResult res;
+    bool has_hash = false;
+    uint64_t hash = 0;
+    int handle = 0;
+    std::shared_ptr<ParsedChart> chart = read_chart_snapshot(data, size, res, has_hash, hash);
+    if (!chart) {
+        res = ParseResult();
+        res.error_code = SNAPSHOT_INVALID;
+    } else if (has_hash) {
+        handle = chart_cache.share(hash, res);
+        if (!handle) handle = chart_cache.add(std::move(chart), hash, res);
+    } else {
+        handle = chart_cache.add(std::move(chart));
     }
-    j["judge_line_stats"] = judge_line_stats_json;
+    result_str = load_result(res, handle);
+    return result_str.c_str();
+}
 
-    j["error"] = res.error_code;
+extern "C" void release_chart(int handle) {
+    chart_cache.erase(handle);
+    pez_sources.erase(handle);
+}
 
-    return j.dump();
+// 句柄是否仍然有效（换出为紧凑形式的谱面也算）
+extern "C" int has_chart(int handle) {
+    return chart_cache.contains(handle) ? 1 : 0;
 }
 
-extern "C" const char* parse_json(const char* json_str, size_t json_len) {
+// 调整已解析谱面常驻内存的预算（字节），0 表示不限
+extern "C" void set_chart_budget(size_t bytes) {
+    chart_cache.set_budget(bytes);
+}
+
+/* 谱面登记表的占用：
+ * {"budget": ..., "handleCount": ..., "residentCount": ..., "residentBytes": ..., "evictedCount": ...,
+ *  "evictedBytes": ..., "evictions": ..., "restores": ..., "hashHits": ...}
+ */
+extern "C" const char* get_chart_cache_stats() {
     static std::string result_str;
-    ParseResult res = parse_single_json(json_str, json_len);
-    result_str = result_to_json(res);
+    ChartCacheStats stats = chart_cache.stats();
+    result_str = json{
+        {"budget", stats.budget},
+        {"handleCount", stats.handle_count},
+        {"residentCount", stats.resident_count},
+        {"residentBytes", stats.resident_bytes},
+        {"evictedCount", stats.evicted_count},
+        {"evictedBytes", stats.evicted_bytes},
+        {"evictions", stats.evictions},
+        {"restores", stats.restores},
+        {"hashHits", stats.hash_hits}
+    }.dump();
     return result_str.c_str();
 }
 
 extern "C" const char* extract_pez(const unsigned char* pez_data, size_t data_size) {
-    mz_zip_archive zip_archive;
-    memset(&zip_archive, 0, sizeof(zip_archive));
-
-    // 初始化 ZIP 读取器
-    if (!mz_zip_reader_init_mem(&zip_archive, pez_data, data_size, 0)) {
-        // result_str = result_to_json(res);
-        // return result_str.c_str();
-        return "(failed)";
+    int error_code = PEZ_OK;
+    char* json_data = extract_pez_chart(pez_data, data_size, nullptr, &error_code);
+    if (json_data) {
+        return json_data;
     }
-    
-    char* json_str;
-    for (int i = 0; i < mz_zip_reader_get_num_files(&zip_archive); i++) {
-        mz_zip_archive_file_stat file_info;
-        if (!mz_zip_reader_file_stat(&zip_archive, i, &file_info)) continue;
-        
-        char filename[256];
-        if (!mz_zip_reader_get_filename(&zip_archive, i, filename, sizeof(filename))) continue;
-
-        if (strstr(filename, ".json") == nullptr) continue;
-        
-        void* json_data = malloc(file_info.m_uncomp_size + 1);
-        if (!json_data) {
-            mz_zip_reader_end(&zip_archive);
-            return "(failed due to memory)";
-        }
 
-        if (mz_zip_reader_extract_to_mem(&zip_archive, i, json_data, 
-            file_info.m_uncomp_size, 0)) {
-            ((char*)json_data)[file_info.m_uncomp_size] = '\0';
-            mz_zip_reader_end(&zip_archive);
-            return (const char*)json_data;
-        } else {
-            free(json_data);
-            mz_zip_reader_end(&zip_archive);
-            return "(failed while extracting)";
-        }
+    switch (error_code) {
+        case PEZ_INIT_FAILED:     return "(failed)";
+        case PEZ_CHART_NOT_FOUND: return "(failed not found)";
+        default:                  return "(failed while extracting)";
     }
+}
 
-    mz_zip_reader_end(&zip_archive);
-    // result_str = result_to_json(res);
-    // return result_str.c_str();
-    return "(failed not found)";
+/* 列出 PEZ 中的谱面候选，返回 JSON：
+ * {"error": 0, "manifestChart": "...", "chart": "...", "candidates": [{"name": "...", "size": 123}, ...]}
+ * chart 是 load_pez / extract_pez 实际会载入的条目。
+ */
+extern "C" const char* pez_chart_candidates(const unsigned char* pez_data, size_t data_size) {
+    static std::string result_str;
+    PezChartList list = list_pez_charts(pez_data, data_size);
+    json result = {
+        {"error", list.error_code},
+        {"manifestChart", list.manifest_chart},
+        {"chart", list.chart},
+        {"candidates", json::array()}
+    };
+    for (const PezChartEntry& entry : list.candidates) {
+        result["candidates"].push_back({{"name", entry.name}, {"size", entry.size}});
+    }
+    result_str = result.dump(-1, ' ', false, json::error_handler_t::replace);
+    return result_str.c_str();
 }
 
-static std::vector<std::string> merge_chunks;
+/* 分块传入的表单在到达时就送进推式解析器，finalize_merge 时基本已经解析完，
+ * 也不必把所有分块同时留在内存里。提前到达的块先暂存，轮到它时再解析。
+ */
+struct FormParser {
+    json form;
+    JsonDomSax dom{form, false};
+    JsonPushParser<JsonDomSax> parser{dom};
+};
+
+static std::unique_ptr<FormParser> form_parser;
+static std::map<int, std::string> pending_chunks;
+static int next_chunk = 0;
 static int total_chunks = 0;
 static std::mutex chunks_mutex;
 
 extern "C" void init_merge(int total) {
     std::lock_guard<std::mutex> lock(chunks_mutex);
-    merge_chunks.clear();
+    form_parser.reset(new FormParser());
+    pending_chunks.clear();
+    next_chunk = 0;
     total_chunks = total;
-    merge_chunks.reserve(total); // 预分配空间
 }
 
 extern "C" int process_merge_chunk(int chunk_index, int total, const char* data, size_t len) {
     std::lock_guard<std::mutex> lock(chunks_mutex);
-    if (chunk_index < 0 || chunk_index >= total || total != total_chunks) {
+    PerfScope scope(PerfPhase::ChunkReceive, len);
+    if (!form_parser || chunk_index < next_chunk || chunk_index >= total || total != total_chunks) {
         return -1; // 块序号或总块数不匹配
     }
     if (!data || len == 0) {
         return -2; // 空数据
     }
-    // 存储当前块
-    if (chunk_index >= merge_chunks.size()) {
-        merge_chunks.resize(chunk_index + 1);
+    if (chunk_index > next_chunk) {
+        pending_chunks[chunk_index] = std::string(data, len);
+        return 0;
+    }
+
+    // 格式错误不在这里报告，留到 finalize_merge 时按空表单处理
+    form_parser->parser.feed(data, len);
+    next_chunk++;
+    for (auto it = pending_chunks.find(next_chunk); it != pending_chunks.end();
+         it = pending_chunks.find(next_chunk)) {
+        form_parser->parser.feed(it->second.data(), it->second.size());
+        pending_chunks.erase(it);
+        next_chunk++;
     }
-    merge_chunks[chunk_index] = std::string(data, len);
     return 0; // 成功
 }
 
-json merge_json(json form_json) {
-    static std::string result_str;
-    result_str = "";
-
-    if (!form_json.contains("firstCardId") || !form_json["firstCardId"].is_number() ||
-        !form_json.contains("truncateStart") || !form_json["truncateStart"].is_boolean() ||
-        !form_json.contains("truncateEnd") || !form_json["truncateEnd"].is_boolean() ||
-        !form_json.contains("cards") || !form_json["cards"].is_array()) {
-        result_str = "{error: -2, message: Missing required fields in form}";
-        return json::parse(result_str);
-    }
+// 最近一次合并的结果，留在模块里由前端分块取走，避免一次性转成 JS 字符串
+static OutputBuffer merge_result;
 
-    int first_card_id = form_json["firstCardId"].get<int>();
-    bool truncate_start = form_json["truncateStart"].get<bool>();
-    bool truncate_end = form_json["truncateEnd"].get<bool>();
-    auto& cards_array = form_json["cards"];
-
-    json base_chart;
-    for (auto& card : cards_array) {
-        if (card.contains("id") && card["id"].is_number() && 
-            card["id"].get<int>() == first_card_id &&
-            card.contains("chartJson") && card["chartJson"].is_string()) {
-            base_chart = json::parse(card["chartJson"].get<std::string>());
-            break;
-        }
-    }
+// 合并时的线程数，0 表示按硬件线程数；未以 -pthread 构建时总是单线程
+static unsigned merge_threads = 0;
 
-    json merged = json::object();
-    for (auto& [key, value] : base_chart.items()) {
-        if (key != "judgeLineList") {
-            merged[key] = value;
-        }
-    }
-    int judge_line_count = 0;
-
-    json& merged_judge_lines = merged["judgeLineList"] = json::array();
-    if (base_chart.contains("judgeLineList") && base_chart["judgeLineList"].is_array()) {
-        judge_line_count = base_chart["judgeLineList"].size();
-        for (auto& line : base_chart["judgeLineList"]) {
-            json line_frame = json::object();
-            for (auto& [key, value] : line.items()) {
-                if (key != "eventLayers" && key != "notes") {
-                    line_frame[key] = value;
-                }
-            }
-            
-            line_frame["eventLayers"] = json::array();
-            for (int i = 0; i < 4; ++i) { // 四层事件
-                json layer_events = {
-                    {"alphaEvents", json::array()},
-                    {"moveXEvents", json::array()},
-                    {"moveYEvents", json::array()},
-                    {"rotateEvents", json::array()},
-                    {"speedEvents", json::array()}
-                };
-                line_frame["eventLayers"].push_back(layer_events);
-            }
+extern "C" void set_merge_threads(int threads) {
+    merge_threads = threads < 0 ? 1 : static_cast<unsigned>(threads);
+}
 
-            line_frame["notes"] = json::array();
-            merged_judge_lines.push_back(line_frame);
-        }
+/* 执行合并，结果写进 merge_result
+ * 返回 0 表示成功，-2 表示表单缺少字段（结果中为错误信息），-3 表示内存不足。
+ */
+static int run_merge(json form, int indent) {
+    merge_result.clear();
+    bool ok = merge_to_buffer(std::move(form), &chart_cache, indent, merge_result, merge_threads);
+    if (merge_result.failed()) {
+        merge_result.clear();
+        return -3;
     }
+    return ok ? 0 : -2;
+}
 
-    // 复用一下 base_chart
-    for (auto& card : cards_array) {
-        std::vector<JudgeLineConfig> judge_line_configs(judge_line_count);
-
-        TimeSignature default_start = {0, 0, 1};
-        TimeSignature default_end = {0, 0, 1};
-        bool default_copy_events = false;
-        bool default_copy_notes = false;
-
-        if (card.contains("timeControls") && card["timeControls"].is_object()) {
-            auto& time_controls = card["timeControls"];
-            // 解析通用复选框参数
-            if (time_controls.contains("checkboxes") && time_controls["checkboxes"].is_array() && 
-                time_controls["checkboxes"].size() >= 2) {
-                default_copy_events = time_controls["checkboxes"][0].get<bool>();
-                default_copy_notes = time_controls["checkboxes"][1].get<bool>();
+// 分块传入完整表单（卡片可带 chartJson）后执行合并，indent 为缩进空格数，-1 表示紧凑输出
+extern "C" int finalize_merge(int indent) {
+    json mergeForm = json::object();
+    {
+        std::lock_guard<std::mutex> lock(chunks_mutex);
+        if (form_parser) {
+            PerfScope scope(PerfPhase::FormParse);
+            // 缺失的块按空串处理，与原先直接拼接分块的行为一致
+            for (auto& [index, chunk] : pending_chunks) {
+                form_parser->parser.feed(chunk.data(), chunk.size());
             }
-            // 解析通用时间参数
-            if (time_controls.contains("inputs") && time_controls["inputs"].is_array() && 
-                time_controls["inputs"].size() >= 6) {
-                auto& inputs = time_controls["inputs"];
-                default_start = {
-                    inputs[0].get<int>(),
-                    inputs[1].get<int>(),
-                    inputs[2].get<int>()
-                };
-                default_end = {
-                    inputs[3].get<int>(),
-                    inputs[4].get<int>(),
-                    inputs[5].get<int>()
-                };
+            pending_chunks.clear();
+            if (form_parser->parser.finish()) {
+                mergeForm = std::move(form_parser->form);
             }
+            form_parser.reset();
         }
-        std::vector<json> independent_lines;
-        if (card.contains("independentJudgeLines") && card["independentJudgeLines"].is_array()) {
-            independent_lines = card["independentJudgeLines"].get<std::vector<json>>();
-        }
+    }
+    return run_merge(std::move(mergeForm), indent);
+}
 
-        for (int i = 0; i < judge_line_count; ++i) {
-            // 默认使用通用配置
-            JudgeLineConfig config;
-            config.startTime = default_start;
-            config.endTime = default_end;
-            config.copyEvents = default_copy_events;
-            config.copyNotes = default_copy_notes;
-
-            // 查找当前判定线是否有独立配置
-            auto it = std::find_if(independent_lines.begin(), independent_lines.end(),
-                [i](const json& line) {
-                    return line.contains("id") && line["id"].is_number() && line["id"].get<int>() == i;
-                });
-
-            if (it != independent_lines.end()) {
-                // 存在独立配置，处理参数覆盖
-                auto& independent_config = *it;
-                if (independent_config.contains("timeControls") && independent_config["timeControls"].is_object()) {
-                    auto& ind_time_controls = independent_config["timeControls"];
-                    // 处理复选框参数
-                    if (ind_time_controls.contains("checkboxes") && ind_time_controls["checkboxes"].is_array() &&
-                        ind_time_controls["checkboxes"].size() >= 2) {
-                        config.copyEvents = ind_time_controls["checkboxes"][0].get<bool>();
-                        config.copyNotes = ind_time_controls["checkboxes"][1].get<bool>();
-                    }
-                    // 处理时间参数（-1 表示使用通用配置对应值）
-                    if (ind_time_controls.contains("inputs") && ind_time_controls["inputs"].is_array() &&
-                        ind_time_controls["inputs"].size() >= 6) {
-                        auto& ind_inputs = ind_time_controls["inputs"];
-                        // 处理开始时间
-                        config.startTime.measure = (ind_inputs[0].get<int>() == -1) ? default_start.measure : ind_inputs[0].get<int>();
-                        config.startTime.numerator = (ind_inputs[1].get<int>() == -1) ? default_start.numerator : ind_inputs[1].get<int>();
-                        config.startTime.denominator = (ind_inputs[2].get<int>() == -1) ? default_start.denominator : ind_inputs[2].get<int>();
-                        // 处理结束时间
-                        config.endTime.measure = (ind_inputs[3].get<int>() == -1) ? default_end.measure : ind_inputs[3].get<int>();
-                        config.endTime.numerator = (ind_inputs[4].get<int>() == -1) ? default_end.numerator : ind_inputs[4].get<int>();
-                        config.endTime.denominator = (ind_inputs[5].get<int>() == -1) ? default_end.denominator : ind_inputs[5].get<int>();
-                    }
-                }
-            }
+/* 只传设置表单的合并入口
+ * 各卡片的谱面事先以原始字节经 load_chart 载入，表单里的卡片只带上句柄（handle），
+ * 不必把每份谱面转义成字符串塞进表单、再分块拼接后整体重新解析。
+ */
+extern "C" int merge_cards(const char* form_str, size_t form_len, int indent) {
+    PerfScope scope(PerfPhase::FormParse, form_len);
+    json form = json::parse(form_str, form_str + form_len, nullptr, false);
+    scope.stop();
+    if (form.is_discarded()) {
+        form = json::object();
+    }
+    return run_merge(std::move(form), indent);
+}
 
-            // 存入配置向量
-            judge_line_configs[i] = config;
-
-            /*
-            emscripten_log(EM_LOG_DEBUG, 
-                "JudgeLine %d config: start=(%d, %d, %d), end=(%d, %d, %d), copyEvents=%d, copyNotes=%d",
-                i,  // 判定线编号
-                config.startTime.measure,    // 开始时间-小节
-                config.startTime.numerator,  // 开始时间-分子
-                config.startTime.denominator,// 开始时间-分母
-                config.endTime.measure,      // 结束时间-小节
-                config.endTime.numerator,    // 结束时间-分子
-                config.endTime.denominator,  // 结束时间-分母
-                config.copyEvents ? 1 : 0,   // 复制事件（0/1表示false/true）
-                config.copyNotes ? 1 : 0     // 复制音符（0/1表示false/true）
-            );
-            */
-        }
+// 句柄对应的谱面是否以 PEZ 载入且原包仍在模块中
+extern "C" int has_pez(int handle) {
+    return pez_sources.count(handle) ? 1 : 0;
+}
 
-        if (card.contains("chartJson") && card["chartJson"].is_string()) {
-            base_chart = json::parse(card["chartJson"].get<std::string>());
-            if (base_chart.contains("judgeLineList") && base_chart["judgeLineList"].is_array()) {
-                size_t idx = 0;
-                auto to_total_beats = [](const TimeSignature& ts) -> double {
-                    int denom = ts.denominator;
-                    if (denom == 0) denom = 1; // 避免除零错误
-                    return ts.measure + 
-                        static_cast<double>(ts.numerator) / denom;
-                };
-                
-                auto parse_time_array = [](const json& arr) -> TimeSignature {
-                    TimeSignature ts = {0, 0, 1};
-                    if (arr.size() >= 3) {
-                        ts.measure = arr[0].get<int>();
-                        ts.numerator = arr[1].get<int>();
-                        ts.denominator = arr[2].get<int>() > 0 ? arr[2].get<int>() : 1;
-                    }
-                    return ts;
-                };
-
-                for (auto& line : base_chart["judgeLineList"]) {
-                    JudgeLineConfig& config = judge_line_configs[idx];
-                    double truncate_start_beats = to_total_beats(config.startTime);
-                    double truncate_end_beats = to_total_beats(config.endTime);
-                    if (truncate_start_beats > truncate_end_beats) {
-                        idx++;
-                        continue;
-                    }
-
-                    if (config.copyEvents) {
-                        // 复制事件
-                        if (line.contains("eventLayers") && line["eventLayers"].is_array()) {
-                            size_t layer_idx = 0;
-                            for (auto& layer : line["eventLayers"]) {
-                                // 只处理前 4 层事件
-                                if (layer_idx >= 4) break;
-                                
-                                // 遍历事件类型
-                                const std::vector<std::string> event_types = {
-                                    "alphaEvents", "moveXEvents", "moveYEvents", 
-                                    "rotateEvents", "speedEvents"
-                                };
-                                
-                                for (const auto& event_type : event_types) {
-                                    if (layer.contains(event_type) && layer[event_type].is_array()) {
-                                        for (auto& event : layer[event_type]) {
-                                            // 检查事件是否包含有效时间信息
-                                            if (!has_start_end_time(event)) continue;
-                                            
-                                            TimeSignature event_start = parse_time_array(event["startTime"]);
-                                            TimeSignature event_end = parse_time_array(event["endTime"]);
-                                            
-                                            double event_start_beats = to_total_beats(event_start);
-                                            double event_end_beats = to_total_beats(event_end);
-                                            
-                                            bool pass_start = false;
-                                            bool pass_end = false;
-                                            
-                                            if (truncate_start) {
-                                                pass_start = (event_start_beats >= truncate_start_beats);
-                                            } else {
-                                                pass_start = (event_end_beats >= truncate_start_beats);
-                                            }
-                                            
-                                            if (truncate_end) {
-                                                pass_end = (event_end_beats <= truncate_end_beats);
-                                            } else {
-                                                pass_end = (event_start_beats <= truncate_end_beats);
-                                            }
-                                            
-                                            // 同时满足条件则复制事件
-                                            if (pass_start && pass_end) {
-                                                merged_judge_lines[idx]["eventLayers"][layer_idx][event_type].push_back(event);
-                                            }
-                                        }
-                                    }
-                                }
-                                layer_idx++;
-                            }
-                        }
-                    }
-                    if (config.copyNotes) {
-                        // 复制音符
-                        if (line.contains("notes") && line["notes"].is_array()) {
-                            for (auto& note : line["notes"]) {
-                                // 检查音符是否包含有效时间信息
-                                if (!has_start_end_time(note)) continue;
-                                
-                                TimeSignature note_start = parse_time_array(note["startTime"]);
-                                TimeSignature note_end = parse_time_array(note["endTime"]);
-                                
-                                double note_start_beats = to_total_beats(note_start);
-                                double note_end_beats = to_total_beats(note_end);
-                                
-                                // 筛选条件判断
-                                bool pass_start = false;
-                                bool pass_end = false;
-                                
-                                if (truncate_start) {
-                                    pass_start = (note_start_beats >= truncate_start_beats);
-                                } else {
-                                    pass_start = (note_end_beats >= truncate_start_beats);
-                                }
-
-                                if (truncate_end) {
-                                    pass_end = (note_end_beats <= truncate_end_beats);
-                                } else {
-                                    pass_end = (note_start_beats <= truncate_end_beats);
-                                }
-                                
-                                // 同时满足条件则复制音符到合并结果的对应判定线
-                                if (pass_start && pass_end) {
-                                    merged_judge_lines[idx]["notes"].push_back(note);
-                                }
-                            }
-                        }
-                    }
-                    
-                    idx++;
-                }
-            }
-        }
-    }
-    
-    return merged;
+/* 把 merge_result 中的谱面连同句柄 base_handle 的 PEZ 原包中的其余资源打包成 PEZ，替换掉 merge_result
+ * 资源条目按原样复制压缩数据，耗时与音乐、曲绘的大小基本无关。
+ * 返回 0 表示成功，否则为 PEZ 错误码（没有保留原包时为 PEZ_INIT_FAILED），此时 merge_result 保持不变。
+ */
+extern "C" int package_merge_result(int base_handle) {
+    auto it = pez_sources.find(base_handle);
+    if (it == pez_sources.end()) return PEZ_INIT_FAILED;
+    OutputBuffer pez;
+    int error_code = write_merged_pez(*it->second, merge_result.data(), merge_result.size(), pez);
+    if (error_code != PEZ_OK) return error_code;
+    merge_result.swap(pez);
+    return 0;
 }
 
-extern "C" const char* finalize_merge() {
-    std::lock_guard<std::mutex> lock(chunks_mutex);
-    // 拼接所有分块为完整 JSON 字符串
-    std::string full_json;
-    for (const auto& chunk : merge_chunks) {
-        full_json += chunk;
-    }
+extern "C" size_t merge_result_size() {
+    return merge_result.size();
+}
 
-    /*
-    emscripten_log(EM_LOG_DEBUG, "JSON length: %zu bytes", full_json.size());
+// 结果在 wasm 堆中的地址，可配合 merge_result_size 用 HEAPU8.subarray 直接读取
+extern "C" const char* merge_result_data() {
+    return merge_result.data();
+}
 
-    // 只打印开头和结尾部分（调试用）
-    if (full_json.size() > 1024) {
-        emscripten_log(EM_LOG_DEBUG, "JSON start: %s", full_json.substr(0, 512).c_str());
-        emscripten_log(EM_LOG_DEBUG, "JSON end: %s", full_json.substr(full_json.size()-512).c_str());
-    } else {
-        emscripten_log(EM_LOG_DEBUG, "full_json = %s", full_json.c_str());
-    }
-    */
+// 从 offset 起复制至多 max_len 字节到 dest，返回实际复制的字节数
+extern "C" size_t read_merge_result(size_t offset, char* dest, size_t max_len) {
+    if (offset >= merge_result.size()) return 0;
+    size_t n = std::min(max_len, merge_result.size() - offset);
+    memcpy(dest, merge_result.data() + offset, n);
+    return n;
+}
+
+extern "C" void release_merge_result() {
+    merge_result.clear();
+}
+
+/* 自上次 reset_perf_report 以来各阶段的耗时（ms）、处理的字节数与次数，以及堆的峰值占用：
+ * {"phases": {"chunkReceive": {"ms": ..., "bytes": ..., "calls": ...}, "formParse": ..., "chartParse": ...,
+ *             "frameBuild": ..., "selection": ..., "serialization": ...,
+ *             "snapshot": ..., "restore": ...},
+ *  "heapHighWater": ..., "heapInUse": ..., "heapSize": ...}
+ */
+extern "C" const char* get_perf_report() {
+    static std::string result_str;
+    result_str = perf_report_json();
+    return result_str.c_str();
+}
 
-    // 执行合并逻辑
-    json mergeForm = json::parse(full_json);
-    json result = merge_json(mergeForm);
+extern "C" void reset_perf_report() {
+    perf_reset();
+}
 
-    std::string result_str = result.dump(3);
-    char* output = static_cast<char*>(malloc(result_str.size() + 1));
-    strcpy(output, result_str.c_str());
-    return output;
-}
\ No newline at end of file
+/* 当前的分配统计（以 -DALLOC_TRACKING=ON 构建时才有数值）：
+ * {"enabled": ..., "allocations": ..., "frees": ..., "liveBytes": ..., "peakBytes": ..., "totalBytes": ...}
+ * peakBytes 为自上次 reset_perf_report 以来的峰值；各阶段的峰值见 get_perf_report
+ */
+extern "C" const char* get_alloc_stats() {
+    static std::string result_str;
+    result_str = alloc_stats_json();
+    return result_str.c_str();
+}
@@ -0,0 +1,500 @@
+#pragma once
+
+/* 可以分段喂入的 JSON 解析器
+ * nlohmann 的解析器只能从一个完整的输入中拉取字符，而合并表单是分块传进来的。
+ * 这里按字节维护解析状态，每收到一块就把能确定的 token 立即转成 SAX 事件，
+ * 块与块之间可以在任意位置断开（字符串、转义、数字、UTF-8 多字节序列中间都可以）。
+ * 语法与 nlohmann 默认设置一致：严格 JSON，不允许注释，可以带 UTF-8 BOM，
+ * 字符串必须是合法的 UTF-8；数字的整数/无符号/浮点划分也与 nlohmann 相同（json_number.h）。
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "json_number.h"
+
+template <typename Sax>
+class JsonPushParser {
+public:
+    explicit JsonPushParser(Sax& sax) : sax_(sax) {}
+
+    // 送入下一段字节，出错后返回 false，之后的输入都会被忽略
+    bool feed(const char* data, size_t len) {
+        for (size_t i = 0; i < len && !failed_; ++i) {
+            if (lex_ == Lex::String && !escape_ && unicode_digits_ < 0 &&
+                !expect_low_surrogate_ && utf8_remaining_ == 0) {
+                // 字符串中的普通 ASCII 字符成段追加
+                size_t run = i;
+                while (run < len) {
+                    unsigned char c = static_cast<unsigned char>(data[run]);
+                    if (c == '"' || c == '\\' || c < 0x20 || c >= 0x80) break;
+                    ++run;
+                }
+                token_.append(data + i, run - i);
+                i = run;
+                if (i == len) break;
+            }
+            step(static_cast<unsigned char>(data[i]));
+        }
+        return !failed_;
+    }
+
+    // 输入结束，返回整份文档是否合法
+    bool finish() {
+        if (failed_) return false;
+        if (lex_ == Lex::Number) {
+            if (!end_number()) return fail();
+        }
+        if (lex_ != Lex::None || expect_ != Expect::Done) return fail();
+        return true;
+    }
+
+    bool failed() const { return failed_; }
+
+private:
+    enum class Expect { Value, FirstValue, Key, FirstKey, Colon, CommaOrClose, Done };
+    enum class Lex { None, Bom, String, Number, Literal };
+    enum class Num { Minus, Zero, Int, Dot, Frac, Exp, ExpSign, ExpDigits };
+
+    Sax& sax_;
+    std::vector<char> containers_;   // '{' 或 '['
+    Expect expect_ = Expect::Value;
+    Lex lex_ = Lex::None;
+    bool failed_ = false;
+    bool started_ = false;
+    std::string token_;
+
+    // 字符串状态
+    bool is_key_ = false;
+    bool escape_ = false;
+    int unicode_digits_ = -1;       // 正在读取 \uXXXX 的第几位，-1 表示不在其中
+    uint32_t codepoint_ = 0;
+    uint32_t high_surrogate_ = 0;   // 等待低代理项的高代理项
+    bool expect_low_surrogate_ = false;
+    int utf8_remaining_ = 0;
+    unsigned char utf8_lo_ = 0x80;
+    unsigned char utf8_hi_ = 0xBF;
+
+    // 数字与字面量状态
+    Num num_ = Num::Int;
+    bool num_is_float_ = false;
+    const char* literal_ = nullptr;
+    size_t literal_pos_ = 0;
+    int bom_pos_ = 0;
+
+    bool fail() {
+        failed_ = true;
+        return false;
+    }
+
+    static bool is_space(unsigned char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    static int hex_value(unsigned char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    void step(unsigned char c) {
+        switch (lex_) {
+            case Lex::String:  string_char(c); return;
+            case Lex::Number:
+                if (number_char(c)) return;
+                // 数字在第一个不属于它的字符处结束，该字符按普通字符继续处理
+                if (!end_number()) {
+                    fail();
+                    return;
+                }
+                break;
+            case Lex::Literal:
+                if (c != static_cast<unsigned char>(literal_[literal_pos_])) {
+                    fail();
+                    return;
+                }
+                if (literal_[++literal_pos_] == '\0') end_literal();
+                return;
+            case Lex::Bom:
+                if (c != (bom_pos_ == 1 ? 0xBB : 0xBF)) {
+                    fail();
+                    return;
+                }
+                if (++bom_pos_ == 3) lex_ = Lex::None;
+                return;
+            case Lex::None:
+                break;
+        }
+        structural(c);
+    }
+
+    void structural(unsigned char c) {
+        if (!started_) {
+            started_ = true;
+            if (c == 0xEF) {
+                lex_ = Lex::Bom;
+                bom_pos_ = 1;
+                return;
+            }
+        }
+        if (is_space(c)) return;
+
+        switch (expect_) {
+            case Expect::Done:
+                fail();
+                return;
+            case Expect::Colon:
+                if (c != ':') {
+                    fail();
+                    return;
+                }
+                expect_ = Expect::Value;
+                return;
+            case Expect::CommaOrClose:
+                if (c == ',') {
+                    expect_ = containers_.back() == '{' ? Expect::Key : Expect::Value;
+                } else if (c == (containers_.back() == '{' ? '}' : ']')) {
+                    close_container();
+                } else {
+                    fail();
+                }
+                return;
+            case Expect::FirstKey:
+                if (c == '}') {
+                    close_container();
+                    return;
+                }
+                [[fallthrough]];
+            case Expect::Key:
+                if (c != '"') {
+                    fail();
+                    return;
+                }
+                begin_string(true);
+                return;
+            case Expect::FirstValue:
+                if (c == ']') {
+                    close_container();
+                    return;
+                }
+                [[fallthrough]];
+            case Expect::Value:
+                begin_value(c);
+                return;
+        }
+    }
+
+    void begin_value(unsigned char c) {
+        switch (c) {
+            case '{':
+                if (!sax_.start_object(static_cast<std::size_t>(-1))) {
+                    fail();
+                    return;
+                }
+                containers_.push_back('{');
+                expect_ = Expect::FirstKey;
+                return;
+            case '[':
+                if (!sax_.start_array(static_cast<std::size_t>(-1))) {
+                    fail();
+                    return;
+                }
+                containers_.push_back('[');
+                expect_ = Expect::FirstValue;
+                return;
+            case '"':
+                begin_string(false);
+                return;
+            case 't': begin_literal("true"); return;
+            case 'f': begin_literal("false"); return;
+            case 'n': begin_literal("null"); return;
+            default:
+                if (c == '-' || (c >= '0' && c <= '9')) {
+                    lex_ = Lex::Number;
+                    token_.clear();
+                    num_is_float_ = false;
+                    num_ = c == '-' ? Num::Minus : (c == '0' ? Num::Zero : Num::Int);
+                    token_.push_back(static_cast<char>(c));
+                    return;
+                }
+                fail();
+                return;
+        }
+    }
+
+    // 一个值结束后，决定接下来期待什么
+    void end_value() {
+        expect_ = containers_.empty() ? Expect::Done : Expect::CommaOrClose;
+    }
+
+    void close_container() {
+        char open = containers_.back();
+        containers_.pop_back();
+        bool ok = open == '{' ? sax_.end_object() : sax_.end_array();
+        if (!ok) {
+            fail();
+            return;
+        }
+        end_value();
+    }
+
+    void begin_literal(const char* literal) {
+        lex_ = Lex::Literal;
+        literal_ = literal;
+        literal_pos_ = 1;
+    }
+
+    void end_literal() {
+        lex_ = Lex::None;
+        bool ok;
+        switch (literal_[0]) {
+            case 't': ok = sax_.boolean(true); break;
+            case 'f': ok = sax_.boolean(false); break;
+            default:  ok = sax_.null(); break;
+        }
+        if (!ok) {
+            fail();
+            return;
+        }
+        end_value();
+    }
+
+    // ---- 数字 ----
+
+    // 返回 false 表示该字符不属于当前数字
+    bool number_char(unsigned char c) {
+        bool digit = c >= '0' && c <= '9';
+        switch (num_) {
+            case Num::Minus:
+                if (c == '0') num_ = Num::Zero;
+                else if (digit) num_ = Num::Int;
+                else return false;
+                break;
+            case Num::Zero:
+            case Num::Int:
+                if (digit && num_ == Num::Int) break;
+                if (c == '.') num_ = Num::Dot;
+                else if (c == 'e' || c == 'E') num_ = Num::Exp;
+                else return false;
+                num_is_float_ = true;
+                break;
+            case Num::Dot:
+                if (!digit) return false;
+                num_ = Num::Frac;
+                break;
+            case Num::Frac:
+                if (digit) break;
+                if (c == 'e' || c == 'E') num_ = Num::Exp;
+                else return false;
+                break;
+            case Num::Exp:
+                if (c == '+' || c == '-') num_ = Num::ExpSign;
+                else if (digit) num_ = Num::ExpDigits;
+                else return false;
+                break;
+            case Num::ExpSign:
+                if (!digit) return false;
+                num_ = Num::ExpDigits;
+                break;
+            case Num::ExpDigits:
+                if (!digit) return false;
+                break;
+        }
+        token_.push_back(static_cast<char>(c));
+        return true;
+    }
+
+    bool end_number() {
+        lex_ = Lex::None;
+        if (num_ != Num::Zero && num_ != Num::Int && num_ != Num::Frac && num_ != Num::ExpDigits) {
+            return false;
+        }
+
+        JsonNumber number;
+        bool ok = parse_json_number(token_.data(), token_.data() + token_.size(), num_is_float_, number);
+        if (ok) {
+            switch (number.kind) {
+                case JsonNumber::Kind::Integer:  ok = sax_.number_integer(number.integer); break;
+                case JsonNumber::Kind::Unsigned: ok = sax_.number_unsigned(number.unsigned_integer); break;
+                case JsonNumber::Kind::Float:    ok = sax_.number_float(number.number_float, token_); break;
+            }
+        }
+        end_value();
+        return ok || fail();
+    }
+
+    // ---- 字符串 ----
+
+    void begin_string(bool is_key) {
+        lex_ = Lex::String;
+        is_key_ = is_key;
+        token_.clear();
+        escape_ = false;
+        unicode_digits_ = -1;
+        expect_low_surrogate_ = false;
+        utf8_remaining_ = 0;
+    }
+
+    void end_string() {
+        lex_ = Lex::None;
+        if (is_key_) {
+            if (!sax_.key(token_)) {
+                fail();
+                return;
+            }
+            expect_ = Expect::Colon;
+        } else {
+            if (!sax_.string(token_)) {
+                fail();
+                return;
+            }
+            end_value();
+        }
+    }
+
+    void append_utf8(uint32_t cp) {
+        if (cp < 0x80) {
+            token_.push_back(static_cast<char>(cp));
+        } else if (cp < 0x800) {
+            token_.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+            token_.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        } else if (cp < 0x10000) {
+            token_.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+            token_.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            token_.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        } else {
+            token_.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+            token_.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+            token_.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            token_.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        }
+    }
+
+    void string_char(unsigned char c) {
+        if (unicode_digits_ >= 0) {
+            int h = hex_value(c);
+            if (h < 0) {
+                fail();
+                return;
+            }
+            codepoint_ = (codepoint_ << 4) | static_cast<uint32_t>(h);
+            if (++unicode_digits_ == 4) {
+                unicode_digits_ = -1;
+                end_unicode_escape();
+            }
+            return;
+        }
+        if (expect_low_surrogate_ && !escape_) {
+            // 高代理项之后必须紧跟 \u 形式的低代理项
+            if (c != '\\') {
+                fail();
+                return;
+            }
+            escape_ = true;
+            return;
+        }
+        if (escape_) {
+            escape_ = false;
+            if (expect_low_surrogate_ && c != 'u') {
+                fail();
+                return;
+            }
+            switch (c) {
+                case '"':  token_.push_back('"'); break;
+                case '\\': token_.push_back('\\'); break;
+                case '/':  token_.push_back('/'); break;
+                case 'b':  token_.push_back('\b'); break;
+                case 'f':  token_.push_back('\f'); break;
+                case 'n':  token_.push_back('\n'); break;
+                case 'r':  token_.push_back('\r'); break;
+                case 't':  token_.push_back('\t'); break;
+                case 'u':
+                    unicode_digits_ = 0;
+                    codepoint_ = 0;
+                    break;
+                default:
+                    fail();
+                    break;
+            }
+            return;
+        }
+        if (utf8_remaining_ > 0) {
+            if (c < utf8_lo_ || c > utf8_hi_) {
+                fail();
+                return;
+            }
+            token_.push_back(static_cast<char>(c));
+            utf8_remaining_--;
+            utf8_lo_ = 0x80;
+            utf8_hi_ = 0xBF;
+            return;
+        }
+
+        if (c == '"') {
+            end_string();
+        } else if (c == '\\') {
+            escape_ = true;
+        } else if (c < 0x20) {
+            fail();
+        } else if (c < 0x80) {
+            token_.push_back(static_cast<char>(c));
+        } else {
+            begin_utf8(c);
+        }
+    }
+
+    void end_unicode_escape() {
+        uint32_t cp = codepoint_;
+        if (expect_low_surrogate_) {
+            expect_low_surrogate_ = false;
+            if (cp < 0xDC00 || cp > 0xDFFF) {
+                fail();
+                return;
+            }
+            append_utf8(0x10000 + ((high_surrogate_ - 0xD800) << 10) + (cp - 0xDC00));
+            return;
+        }
+        if (cp >= 0xD800 && cp <= 0xDBFF) {
+            high_surrogate_ = cp;
+            expect_low_surrogate_ = true;
+            return;
+        }
+        if (cp >= 0xDC00 && cp <= 0xDFFF) {
+            fail();
+            return;
+        }
+        append_utf8(cp);
+    }
+
+    // 多字节 UTF-8 序列的首字节，决定后续字节的个数与第一个后续字节的范围
+    void begin_utf8(unsigned char c) {
+        utf8_lo_ = 0x80;
+        utf8_hi_ = 0xBF;
+        if (c >= 0xC2 && c <= 0xDF) {
+            utf8_remaining_ = 1;
+        } else if (c == 0xE0) {
+            utf8_remaining_ = 2;
+            utf8_lo_ = 0xA0;
+        } else if ((c >= 0xE1 && c <= 0xEC) || c == 0xEE || c == 0xEF) {
+            utf8_remaining_ = 2;
+        } else if (c == 0xED) {
+            utf8_remaining_ = 2;
+            utf8_hi_ = 0x9F;
+        } else if (c == 0xF0) {
+            utf8_remaining_ = 3;
+            utf8_lo_ = 0x90;
+        } else if (c >= 0xF1 && c <= 0xF3) {
+            utf8_remaining_ = 3;
+        } else if (c == 0xF4) {
+            utf8_remaining_ = 3;
+            utf8_hi_ = 0x8F;
+        } else {
+            fail();
+            return;
+        }
+        token_.push_back(static_cast<char>(c));
+    }
+};
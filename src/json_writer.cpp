@@ -0,0 +1,205 @@
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "json_writer.h"
+
+OutputBuffer::~OutputBuffer() {
+    free(data_);
+}
+
+void OutputBuffer::reserve(size_t n) {
+    if (failed_ || n <= capacity_) return;
+    char* p = static_cast<char*>(realloc(data_, n));
+    if (!p) {
+        failed_ = true;
+        return;
+    }
+    data_ = p;
+    capacity_ = n;
+}
+
+void OutputBuffer::append(const char* s, size_t n) {
+    if (failed_) return;
+    // 多留一个字节给结尾的 '\0'
+    if (size_ + n + 1 > capacity_) {
+        size_t grow = capacity_ < (1 << 16) ? (1 << 16) : capacity_ * 2;
+        reserve(std::max(grow, size_ + n + 1));
+        if (failed_) return;
+    }
+    memcpy(data_ + size_, s, n);
+    size_ += n;
+}
+
+void OutputBuffer::write_at(size_t offset, const char* s, size_t n) {
+    if (failed_) return;
+    size_t overlap = std::min(n, size_ - offset);
+    memcpy(data_ + offset, s, overlap);
+    append(s + overlap, n - overlap);
+}
+
+void OutputBuffer::clear() {
+    free(data_);
+    data_ = nullptr;
+    size_ = 0;
+    capacity_ = 0;
+    failed_ = false;
+}
+
+void OutputBuffer::swap(OutputBuffer& other) {
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    std::swap(capacity_, other.capacity_);
+    std::swap(failed_, other.failed_);
+}
+
+char* OutputBuffer::release() {
+    if (failed_) {
+        return nullptr;
+    }
+    reserve(size_ + 1);
+    if (failed_) return nullptr;
+    data_[size_] = '\0';
+    char* p = data_;
+    data_ = nullptr;
+    size_ = 0;
+    capacity_ = 0;
+    return p;
+}
+
+namespace {
+
+// 让 nlohmann 的序列化器直接写进 OutputBuffer
+class BufferAdapter : public nlohmann::detail::output_adapter_protocol<char> {
+public:
+    explicit BufferAdapter(OutputBuffer& out) : out_(out) {}
+    void write_character(char c) override { out_.push_back(c); }
+    void write_characters(const char* s, std::size_t length) override { out_.append(s, length); }
+
+private:
+    OutputBuffer& out_;
+};
+
+// 不需要转义的键可以直接写出
+bool is_plain_key(const char* k, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        unsigned char c = static_cast<unsigned char>(k[i]);
+        if (c < 0x20 || c >= 0x80 || c == '"' || c == '\\') return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+JsonWriter::JsonWriter(OutputBuffer& out, int indent)
+    : out_(out), indent_(indent),
+      serializer_(new nlohmann::detail::serializer<json>(std::make_shared<BufferAdapter>(out), ' ')) {}
+
+JsonWriter::JsonWriter(OutputBuffer& out, int indent, size_t depth, bool has_items)
+    : JsonWriter(out, indent) {
+    stack_.assign(depth, {true});
+    if (depth > 0) stack_.back().has_items = has_items;
+}
+
+void JsonWriter::write(const char* s) {
+    write(s, strlen(s));
+}
+
+void JsonWriter::newline(size_t depth) {
+    out_.push_back('\n');
+    static const char spaces[] = "                                ";
+    size_t n = depth * static_cast<size_t>(indent_);
+    while (n > 0) {
+        size_t k = std::min(n, sizeof(spaces) - 1);
+        write(spaces, k);
+        n -= k;
+    }
+}
+
+// 在值之前写出分隔符与换行缩进；紧跟在键后面的值不需要
+void JsonWriter::begin_value() {
+    if (after_key_) {
+        after_key_ = false;
+        return;
+    }
+    if (stack_.empty()) return;
+    Level& top = stack_.back();
+    if (top.has_items) out_.push_back(',');
+    top.has_items = true;
+    if (indent_ >= 0) newline(stack_.size());
+}
+
+void JsonWriter::begin_container(char open) {
+    begin_value();
+    out_.push_back(open);
+    stack_.push_back({false});
+}
+
+void JsonWriter::end_container(char close) {
+    bool has_items = stack_.back().has_items;
+    stack_.pop_back();
+    if (has_items && indent_ >= 0) newline(stack_.size());
+    out_.push_back(close);
+}
+
+void JsonWriter::begin_object() { begin_container('{'); }
+void JsonWriter::end_object() { end_container('}'); }
+void JsonWriter::begin_array() { begin_container('['); }
+void JsonWriter::end_array() { end_container(']'); }
+
+void JsonWriter::write_key(const char* k, size_t n) {
+    begin_value();
+    if (is_plain_key(k, n)) {
+        out_.push_back('"');
+        write(k, n);
+        out_.push_back('"');
+    } else {
+        // 需要转义或校验 UTF-8 的键交给序列化器，保证与 dump 一致
+        serializer_->dump(json(std::string(k, n)), false, false, 0);
+    }
+    if (indent_ >= 0) {
+        write(": ", 2);
+    } else {
+        out_.push_back(':');
+    }
+    after_key_ = true;
+}
+
+void JsonWriter::key(const char* k) { write_key(k, strlen(k)); }
+void JsonWriter::key(const std::string& k) { write_key(k.data(), k.size()); }
+
+void JsonWriter::value(int64_t v) {
+    begin_value();
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof(buf), v);
+    write(buf, static_cast<size_t>(res.ptr - buf));
+}
+
+void JsonWriter::value(double v) {
+    begin_value();
+    if (!std::isfinite(v)) {
+        write("null", 4);
+        return;
+    }
+    char buf[64];
+    char* end = nlohmann::detail::to_chars(buf, buf + sizeof(buf), v);
+    write(buf, static_cast<size_t>(end - buf));
+}
+
+void JsonWriter::value(const json& v) {
+    begin_value();
+    if (indent_ >= 0) {
+        serializer_->dump(v, true, false, static_cast<unsigned int>(indent_),
+                          static_cast<unsigned int>(stack_.size() * indent_));
+    } else {
+        serializer_->dump(v, false, false, 0);
+    }
+}
+
+void JsonWriter::append_fragment(const char* data, size_t n) {
+    if (n == 0) return;
+    write(data, n);
+    if (!stack_.empty()) stack_.back().has_items = true;
+}
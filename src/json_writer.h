@@ -0,0 +1,98 @@
+#pragma once
+
+/* 流式 JSON 输出
+ * 合并结果不再先建成一棵 json 再 dump 成 std::string、再复制到 malloc 的缓冲区，
+ * 而是边遍历边写进一块可增长的缓冲区，最后把这块缓冲区直接交给调用者。
+ * 输出格式与 json::dump(indent) 逐字节一致：对象的键按字典序，浮点数同样使用 Grisu2。
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "chart_core.h"
+
+// 与 json::dump 逐字节一致依赖 nlohmann 的内部实现（detail::serializer、output_adapter_protocol、to_chars），由 chart_equivalence 核对
+static_assert(NLOHMANN_JSON_VERSION_MAJOR == 3 && NLOHMANN_JSON_VERSION_MINOR == 12,
+              "JsonWriter 依赖 nlohmann json 3.12 的 detail::serializer 与 detail::to_chars");
+
+// malloc 分配的可增长缓冲区，内存不足时停止写入并记下失败
+class OutputBuffer {
+public:
+    OutputBuffer() = default;
+    ~OutputBuffer();
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    void append(const char* s, size_t n);
+    void push_back(char c) { append(&c, 1); }
+    // 从 offset 处写入，覆盖已有的内容，超出部分追加；offset 不能超过当前长度
+    void write_at(size_t offset, const char* s, size_t n);
+    void reserve(size_t n);
+    // 别处的写入失败（例如并行写出的某一段内存不足）时手动标记
+    void mark_failed() { failed_ = true; }
+    // 释放缓冲区并清除失败标记
+    void clear();
+    void swap(OutputBuffer& other);
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool failed() const { return failed_; }
+
+    // 交出以 '\0' 结尾的缓冲区，调用者负责 free；写入失败时返回 nullptr
+    char* release();
+
+private:
+    char* data_ = nullptr;
+    size_t size_ = 0;
+    size_t capacity_ = 0;
+    bool failed_ = false;
+};
+
+class JsonWriter {
+public:
+    // indent < 0 时输出紧凑格式，否则与 dump(indent) 相同
+    JsonWriter(OutputBuffer& out, int indent);
+    /* 从第 depth 层容器的中间开始写，用于在别的线程里写出数组中的一段元素，
+     * 之后用 append_fragment 接回去；has_items 表示这段之前已经有元素（开头要补逗号）。
+     */
+    JsonWriter(OutputBuffer& out, int indent, size_t depth, bool has_items);
+
+    void begin_object();
+    void end_object();
+    void begin_array();
+    void end_array();
+
+    // 对象中的键，随后必须写入一个值
+    void key(const char* k);
+    void key(const std::string& k);
+
+    void value(int64_t v);
+    void value(double v);
+    // 整棵子树交给 nlohmann 的序列化器，缩进接在当前层级之后
+    void value(const json& v);
+
+    // 接上用片段构造函数在同一层级写出的内容
+    void append_fragment(const char* data, size_t n);
+
+private:
+    struct Level {
+        bool has_items;
+    };
+
+    OutputBuffer& out_;
+    int indent_;
+    std::vector<Level> stack_;
+    bool after_key_ = false;
+    std::unique_ptr<nlohmann::detail::serializer<json>> serializer_;
+
+    void write(const char* s, size_t n) { out_.append(s, n); }
+    void write(const char* s);
+    void newline(size_t depth);
+    void begin_value();
+    void begin_container(char open);
+    void end_container(char close);
+    void write_key(const char* k, size_t n);
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+/* 简单的并行执行
+ * 把若干互不相关的任务分给一组线程，调用线程自己也参与，全部完成后返回。
+ * WebAssembly 未启用 pthread（-pthread）时始终在调用线程中顺序执行。
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+#define CHART_NO_THREADS 1
+#endif
+
+// requested 为 0 时使用硬件线程数；不支持线程时返回 1
+inline unsigned resolve_thread_count(unsigned requested) {
+#ifdef CHART_NO_THREADS
+    (void)requested;
+    return 1;
+#else
+    if (requested == 0) requested = std::thread::hardware_concurrency();
+    return requested == 0 ? 1 : requested;
+#endif
+}
+
+/* 以至多 threads 个线程执行 task(0) ... task(count - 1)
+ * 任务按编号由各线程依次领取，各任务之间不能有依赖；执行顺序不确定，结果应写到按编号区分的位置。
+ */
+template <typename F>
+void parallel_for(size_t count, unsigned threads, F&& task) {
+    if (threads > count) threads = static_cast<unsigned>(count);
+    if (threads <= 1) {
+        for (size_t i = 0; i < count; ++i) task(i);
+        return;
+    }
+#ifndef CHART_NO_THREADS
+    std::atomic<size_t> next{0};
+    auto run = [&]() {
+        for (size_t i = next++; i < count; i = next++) task(i);
+    };
+    std::vector<std::thread> pool;
+    pool.reserve(threads - 1);
+    for (unsigned t = 1; t < threads; ++t) pool.emplace_back(run);
+    run();
+    for (std::thread& th : pool) th.join();
+#endif
+}
@@ -0,0 +1,107 @@
+#include <mutex>
+
+#include "chart_core.h"
+#include "perf.h"
+
+#ifdef __EMSCRIPTEN__
+#include <emscripten/heap.h>
+#include <malloc.h>
+#elif defined(__linux__)
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+struct PerfCounter {
+    double ms = 0;
+    uint64_t bytes = 0;
+    uint64_t calls = 0;
+    uint64_t allocations = 0;
+    uint64_t alloc_bytes = 0;
+};
+
+const char* const PHASE_NAMES[] = {
+    "chunkReceive", "formParse", "chartParse", "frameBuild", "selection", "serialization",
+    "snapshot", "restore"
+};
+static_assert(sizeof(PHASE_NAMES) / sizeof(PHASE_NAMES[0]) == static_cast<size_t>(PerfPhase::Count),
+              "每个阶段都要有名字");
+
+std::mutex perf_mutex;
+PerfCounter counters[static_cast<size_t>(PerfPhase::Count)];
+
+}  // namespace
+
+void perf_reset() {
+    std::lock_guard<std::mutex> lock(perf_mutex);
+    for (PerfCounter& counter : counters) counter = PerfCounter();
+    alloc_reset_peak();
+}
+
+void perf_add(PerfPhase phase, double ms, uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(perf_mutex);
+    PerfCounter& counter = counters[static_cast<size_t>(phase)];
+    counter.ms += ms;
+    counter.bytes += bytes;
+    counter.calls++;
+}
+
+void perf_add_alloc(PerfPhase phase, uint64_t allocations, uint64_t alloc_bytes) {
+    std::lock_guard<std::mutex> lock(perf_mutex);
+    PerfCounter& counter = counters[static_cast<size_t>(phase)];
+    counter.allocations += allocations;
+    counter.alloc_bytes += alloc_bytes;
+}
+
+static json alloc_stats_object() {
+    AllocStats stats = alloc_stats();
+    return {
+        {"enabled", alloc_tracking_enabled()},
+        {"allocations", stats.allocations},
+        {"frees", stats.frees},
+        {"liveBytes", stats.live_bytes},
+        {"peakBytes", stats.peak_bytes},
+        {"totalBytes", stats.total_bytes}
+    };
+}
+
+std::string perf_report_json() {
+    json report = json::object();
+    json& phases = report["phases"] = json::object();
+    {
+        std::lock_guard<std::mutex> lock(perf_mutex);
+        for (size_t i = 0; i < static_cast<size_t>(PerfPhase::Count); ++i) {
+            phases[PHASE_NAMES[i]] = {
+                {"ms", counters[i].ms},
+                {"bytes", counters[i].bytes},
+                {"calls", counters[i].calls}
+            };
+            if (alloc_tracking_enabled()) {
+                phases[PHASE_NAMES[i]]["allocs"] = counters[i].allocations;
+                phases[PHASE_NAMES[i]]["allocBytes"] = counters[i].alloc_bytes;
+                phases[PHASE_NAMES[i]]["peakBytes"] = alloc_watch_peak(i);
+            }
+        }
+    }
+
+    if (alloc_tracking_enabled()) report["alloc"] = alloc_stats_object();
+
+#ifdef __EMSCRIPTEN__
+    // 线性内存只增不减，其大小就是峰值；dlmalloc 的 usmblks 为分配器占用的峰值
+    struct mallinfo info = mallinfo();
+    report["heapHighWater"] = static_cast<uint64_t>(info.usmblks);
+    report["heapInUse"] = static_cast<uint64_t>(info.uordblks);
+    report["heapSize"] = static_cast<uint64_t>(emscripten_get_heap_size());
+#elif defined(__linux__)
+    // 本地以进程的峰值常驻内存近似
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        report["heapHighWater"] = static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+    }
+#endif
+    return report.dump();
+}
+
+std::string alloc_stats_json() {
+    return alloc_stats_object().dump();
+}
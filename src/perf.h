@@ -0,0 +1,77 @@
+#pragma once
+
+/* 各阶段的耗时与处理量统计
+ * 在解析、合并的关键位置放一个 PerfScope，累计该阶段的耗时、字节数与次数，
+ * 由 perf_report_json 汇总成 JSON（WASM 的 get_perf_report、命令行的 --stats）。
+ * 多线程同时计时的阶段（例如并行解析卡片谱面）累计的是各线程耗时之和。
+ * 启用分配统计（CHART_ALLOC_TRACKING）时，同时记下每个阶段的分配次数、分配字节数与期间的峰值占用；
+ * 多个线程同时处于同一阶段时，分配次数会把其他阶段同时期的分配也算进来。
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "alloc_tracking.h"
+
+enum class PerfPhase {
+    ChunkReceive,    // 接收表单分块
+    FormParse,       // 解析表单
+    ChartParse,      // 解析谱面（JSON 或 PEZ 中的谱面）
+    FrameBuild,      // 建立合并方案的框架：判定线 frame 与各卡片的时间配置
+    Selection,       // 按时间窗口筛选事件与音符
+    Serialization,   // 输出合并结果
+    Snapshot,        // 生成谱面快照
+    Restore,         // 由快照恢复谱面
+    Count
+};
+
+// 清空累计的统计
+void perf_reset();
+void perf_add(PerfPhase phase, double ms, uint64_t bytes);
+void perf_add_alloc(PerfPhase phase, uint64_t allocations, uint64_t alloc_bytes);
+// 累计统计以及进程（WASM 为线性内存）的峰值占用
+std::string perf_report_json();
+// 分配统计：{"enabled", "allocations", "frees", "liveBytes", "peakBytes", "totalBytes"}
+std::string alloc_stats_json();
+
+// 在作用域结束时把耗时记到 phase 上
+class PerfScope {
+public:
+    explicit PerfScope(PerfPhase phase, uint64_t bytes = 0)
+        : phase_(phase), bytes_(bytes), start_(std::chrono::steady_clock::now()) {
+        if (alloc_tracking_enabled()) {
+            alloc_start_ = alloc_stats();
+            alloc_watch_begin(static_cast<size_t>(phase_));
+        }
+    }
+    ~PerfScope() { stop(); }
+    PerfScope(const PerfScope&) = delete;
+    PerfScope& operator=(const PerfScope&) = delete;
+
+    // 处理量在结束时才知道的阶段（例如输出）用这个补上
+    void add_bytes(uint64_t bytes) { bytes_ += bytes; }
+
+    // 提前结束计时，之后析构时不再重复记录
+    void stop() {
+        if (stopped_) return;
+        stopped_ = true;
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start_;
+        perf_add(phase_, elapsed.count(), bytes_);
+        if (alloc_tracking_enabled()) {
+            alloc_watch_end(static_cast<size_t>(phase_));
+            AllocStats now = alloc_stats();
+            perf_add_alloc(phase_, now.allocations - alloc_start_.allocations,
+                           now.total_bytes - alloc_start_.total_bytes);
+        }
+    }
+
+private:
+    PerfPhase phase_;
+    uint64_t bytes_;
+    std::chrono::steady_clock::time_point start_;
+    bool stopped_ = false;
+    AllocStats alloc_start_;
+};
+
+static_assert(static_cast<size_t>(PerfPhase::Count) <= ALLOC_WATCH_SLOTS, "每个阶段占一个观察槽");
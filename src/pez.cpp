@@ -0,0 +1,294 @@
+#include <cctype>
+#include <cstring>
+#include <cstdlib>
+#include <strings.h>
+
+#include "chart_core.h"
+#include "chart_cache.h"
+#include "json_writer.h"
+#include "pez_archive.h"
+#include "perf.h"
+#include "../include/miniz/miniz.h"
+
+// 包内说明文件，Chart 字段给出谱面的文件名
+static const char* const MANIFEST_NAMES[] = {"info.txt", "info.yml"};
+
+static std::string trim(const std::string& s) {
+    size_t begin = 0, end = s.size();
+    while (begin < end && isspace(static_cast<unsigned char>(s[begin]))) begin++;
+    while (end > begin && isspace(static_cast<unsigned char>(s[end - 1]))) end--;
+    return s.substr(begin, end - begin);
+}
+
+/* 从 info.txt / info.yml 的内容中取出 Chart 字段
+ * 两种格式都是每行一个 "键: 值"，键不区分大小写，yml 的值可能带引号。
+ */
+static std::string manifest_chart_name(const char* text, size_t len) {
+    size_t pos = 0;
+    if (len >= 3 && memcmp(text, "\xEF\xBB\xBF", 3) == 0) pos = 3;
+    while (pos < len) {
+        const char* line = text + pos;
+        const char* nl = static_cast<const char*>(memchr(line, '\n', len - pos));
+        size_t line_len = nl ? static_cast<size_t>(nl - line) : len - pos;
+        pos += line_len + 1;
+
+        const char* colon = static_cast<const char*>(memchr(line, ':', line_len));
+        if (!colon) continue;
+        std::string key = trim(std::string(line, colon - line));
+        if (key.size() != 5 || strncasecmp(key.c_str(), "chart", 5) != 0) continue;
+
+        std::string value = trim(std::string(colon + 1, line + line_len - colon - 1));
+        if (value.size() >= 2 && (value.front() == '"' || value.front() == '\'') &&
+            value.back() == value.front()) {
+            value = value.substr(1, value.size() - 2);
+        }
+        return value;
+    }
+    return std::string();
+}
+
+// 读取说明文件中登记的谱面文件名，没有说明文件或没有 Chart 字段时返回空串
+static std::string find_manifest_chart(mz_zip_archive* zip) {
+    for (const char* manifest : MANIFEST_NAMES) {
+        int index = mz_zip_reader_locate_file(zip, manifest, nullptr, 0);
+        if (index < 0) continue;
+        size_t len = 0;
+        char* text = static_cast<char*>(mz_zip_reader_extract_to_heap(zip, index, &len, 0));
+        if (!text) continue;
+        std::string name = manifest_chart_name(text, len);
+        mz_free(text);
+        if (!name.empty()) return name;
+    }
+    return std::string();
+}
+
+// 文件名以 .json 结尾（不区分大小写），foo.jsonl、a.json.bak 之类不算
+static bool has_json_suffix(const char* filename) {
+    size_t len = strlen(filename);
+    return len >= 5 && strcasecmp(filename + len - 5, ".json") == 0;
+}
+
+/* 包内谱面所在的条目
+ * 有说明文件的 Chart 字段时只在中央目录中按该文件名定位，登记的文件不存在就算找不到谱面；
+ * 没有说明文件时取中央目录中第一个以 .json 结尾的文件。只对选中的条目取 stat。
+ */
+static bool find_chart_entry(mz_zip_archive* zip, mz_uint* index, mz_zip_archive_file_stat* stat) {
+    std::string name = find_manifest_chart(zip);
+    if (!name.empty()) {
+        int found = mz_zip_reader_locate_file(zip, name.c_str(), nullptr, 0);
+        if (found < 0 || !mz_zip_reader_file_stat(zip, static_cast<mz_uint>(found), stat)) return false;
+        *index = static_cast<mz_uint>(found);
+        return true;
+    }
+
+    char filename[MZ_ZIP_MAX_ARCHIVE_FILENAME_SIZE];
+    for (mz_uint i = 0; i < mz_zip_reader_get_num_files(zip); i++) {
+        if (mz_zip_reader_is_file_a_directory(zip, i)) continue;
+        mz_zip_reader_get_filename(zip, i, filename, sizeof(filename));
+        if (!has_json_suffix(filename)) continue;
+        if (!mz_zip_reader_file_stat(zip, i, stat)) return false;
+        *index = i;
+        return true;
+    }
+    return false;
+}
+
+PezChartList list_pez_charts(const unsigned char* pez_data, size_t data_size) {
+    PezChartList list;
+    list.error_code = PEZ_OK;
+    mz_zip_archive zip_archive;
+    memset(&zip_archive, 0, sizeof(zip_archive));
+
+    if (!pez_data || !mz_zip_reader_init_mem(&zip_archive, pez_data, data_size, 0)) {
+        list.error_code = PEZ_INIT_FAILED;
+        return list;
+    }
+
+    list.manifest_chart = find_manifest_chart(&zip_archive);
+
+    // 先按文件名筛选，只对候选条目取 stat
+    char filename[MZ_ZIP_MAX_ARCHIVE_FILENAME_SIZE];
+    for (mz_uint i = 0; i < mz_zip_reader_get_num_files(&zip_archive); i++) {
+        if (mz_zip_reader_is_file_a_directory(&zip_archive, i)) continue;
+        mz_zip_reader_get_filename(&zip_archive, i, filename, sizeof(filename));
+        if (!has_json_suffix(filename)) continue;
+        mz_zip_archive_file_stat stat;
+        if (!mz_zip_reader_file_stat(&zip_archive, i, &stat)) continue;
+        list.candidates.push_back({filename, stat.m_uncomp_size});
+    }
+
+    mz_uint index = 0;
+    mz_zip_archive_file_stat file_info;
+    if (find_chart_entry(&zip_archive, &index, &file_info)) {
+        list.chart = file_info.m_filename;
+    } else {
+        list.error_code = PEZ_CHART_NOT_FOUND;
+    }
+    mz_zip_reader_end(&zip_archive);
+    return list;
+}
+
+char* extract_pez_chart(const unsigned char* pez_data, size_t data_size,
+                        size_t* out_len, int* error_code) {
+    mz_zip_archive zip_archive;
+    memset(&zip_archive, 0, sizeof(zip_archive));
+    if (out_len) *out_len = 0;
+
+    // 初始化 ZIP 读取器
+    if (!pez_data || !mz_zip_reader_init_mem(&zip_archive, pez_data, data_size, 0)) {
+        if (error_code) *error_code = PEZ_INIT_FAILED;
+        return nullptr;
+    }
+
+    mz_uint index = 0;
+    mz_zip_archive_file_stat file_info;
+    if (find_chart_entry(&zip_archive, &index, &file_info)) {
+        size_t json_len = static_cast<size_t>(file_info.m_uncomp_size);
+        char* json_data = static_cast<char*>(malloc(json_len + 1));
+        if (!json_data) {
+            mz_zip_reader_end(&zip_archive);
+            if (error_code) *error_code = PEZ_EXTRACT_FAILED;
+            return nullptr;
+        }
+
+        if (mz_zip_reader_extract_to_mem(&zip_archive, index, json_data, json_len, 0)) {
+            json_data[json_len] = '\0';
+            mz_zip_reader_end(&zip_archive);
+            if (out_len) *out_len = json_len;
+            if (error_code) *error_code = PEZ_OK;
+            return json_data;
+        } else {
+            free(json_data);
+            mz_zip_reader_end(&zip_archive);
+            if (error_code) *error_code = PEZ_EXTRACT_FAILED;
+            return nullptr;
+        }
+    }
+
+    mz_zip_reader_end(&zip_archive);
+    if (error_code) *error_code = PEZ_CHART_NOT_FOUND;
+    return nullptr;
+}
+
+PezArchive::PezArchive(const unsigned char* data, size_t size, bool owned)
+    : data_(data), size_(size), owned_(owned), open_(false) {
+    memset(&zip_, 0, sizeof(zip_));
+    open_ = data_ && mz_zip_reader_init_mem(&zip_, data_, size_, 0);
+}
+
+PezArchive::~PezArchive() {
+    if (open_) mz_zip_reader_end(&zip_);
+    if (owned_) free(const_cast<unsigned char*>(data_));
+}
+
+bool PezArchive::find_chart(mz_uint* index, mz_zip_archive_file_stat* stat) {
+    return open_ && find_chart_entry(&zip_, index, stat);
+}
+
+// miniz 写入器的输出回调；写完数据后会回头补写本地文件头，所以要支持覆盖
+static size_t write_to_buffer(void* opaque, mz_uint64 offset, const void* data, size_t n) {
+    OutputBuffer* out = static_cast<OutputBuffer*>(opaque);
+    if (offset > out->size()) return 0;
+    out->write_at(static_cast<size_t>(offset), static_cast<const char*>(data), n);
+    return out->failed() ? 0 : n;
+}
+
+ZipPassthrough::ZipPassthrough(OutputBuffer& out, size_t reserve) : out_(out) {
+    memset(&zip_, 0, sizeof(zip_));
+    zip_.m_pWrite = write_to_buffer;
+    zip_.m_pIO_opaque = &out_;
+    out_.clear();
+    out_.reserve(reserve);
+    ok_ = mz_zip_writer_init(&zip_, 0) == MZ_TRUE;
+}
+
+ZipPassthrough::~ZipPassthrough() {
+    mz_zip_writer_end(&zip_);
+}
+
+bool ZipPassthrough::copy_entry(PezArchive& src, mz_uint index) {
+    ok_ = ok_ && src.is_open() && mz_zip_writer_add_from_zip_reader(&zip_, src.zip(), index) == MZ_TRUE;
+    return ok_;
+}
+
+bool ZipPassthrough::add(const char* name, const char* data, size_t len) {
+    ok_ = ok_ && mz_zip_writer_add_mem(&zip_, name, data, len, MZ_DEFAULT_COMPRESSION) == MZ_TRUE;
+    return ok_;
+}
+
+bool ZipPassthrough::finish() {
+    ok_ = ok_ && mz_zip_writer_finalize_archive(&zip_) == MZ_TRUE;
+    return ok_ && !out_.failed();
+}
+
+std::shared_ptr<ParsedChart> parse_pez_chart(PezArchive& pez, ParseResult& stats) {
+    ChartStreamParser parser(stats);
+    if (!pez.is_open()) {
+        stats.error_code = PEZ_INIT_FAILED;
+        return nullptr;
+    }
+
+    mz_uint index = 0;
+    mz_zip_archive_file_stat file_info;
+    if (!pez.find_chart(&index, &file_info)) {
+        stats.error_code = PEZ_CHART_NOT_FOUND;
+        return nullptr;
+    }
+
+    mz_zip_reader_extract_iter_state* iter = mz_zip_reader_extract_iter_new(pez.zip(), index, 0);
+    if (!iter) {
+        stats.error_code = PEZ_EXTRACT_FAILED;
+        return nullptr;
+    }
+
+    // 每解压出一块就送进解析器，格式错误时提前停止解压；计时包含解压
+    PerfScope scope(PerfPhase::ChartParse, file_info.m_uncomp_size);
+    char buf[64 * 1024];
+    bool parse_ok = true;
+    size_t n;
+    while (parse_ok && (n = mz_zip_reader_extract_iter_read(iter, buf, sizeof(buf))) > 0) {
+        parse_ok = parser.feed(buf, n);
+    }
+    // 释放时会校验 CRC 与解压出的长度
+    bool extract_ok = mz_zip_reader_extract_iter_free(iter) == MZ_TRUE;
+
+    if (parse_ok && !extract_ok) {
+        stats.error_code = PEZ_EXTRACT_FAILED;
+        return nullptr;
+    }
+    return parser.finish();
+}
+
+std::shared_ptr<ParsedChart> parse_pez_chart(const unsigned char* pez_data, size_t data_size,
+                                             ParseResult& stats) {
+    PezArchive pez(pez_data, data_size, false);
+    return parse_pez_chart(pez, stats);
+}
+
+int write_merged_pez(PezArchive& base, const char* chart_json, size_t chart_len, OutputBuffer& out) {
+    if (!base.is_open()) return PEZ_INIT_FAILED;
+
+    mz_uint chart_index = 0;
+    mz_zip_archive_file_stat chart_info;
+    if (!base.find_chart(&chart_index, &chart_info)) return PEZ_CHART_NOT_FOUND;
+
+    // 谱面以外的资源大小已知，先按原包的大小预留
+    ZipPassthrough writer(out, base.size() + chart_len / 4);
+    for (mz_uint i = 0; i < mz_zip_reader_get_num_files(base.zip()); i++) {
+        bool ok = i == chart_index
+            ? writer.add(chart_info.m_filename, chart_json, chart_len)
+            : writer.copy_entry(base, i);
+        if (!ok) break;
+    }
+    if (!writer.finish()) {
+        out.clear();
+        return PEZ_WRITE_FAILED;
+    }
+    return PEZ_OK;
+}
+
+int write_merged_pez(const unsigned char* base_pez, size_t base_size,
+                     const char* chart_json, size_t chart_len, OutputBuffer& out) {
+    PezArchive base(base_pez, base_size, false);
+    return write_merged_pez(base, chart_json, chart_len, out);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+/* 留在内存中的 PEZ 原包与 ZIP 直通写入
+ * 载入 PEZ 时中央目录只解析一次，原包按句柄保留，导出时音乐、曲绘等条目
+ * 直接把压缩好的数据逐字节复制进新包，不经过解压与重新压缩。
+ */
+
+#include <cstddef>
+#include <memory>
+
+#include "chart_core.h"
+#include "chart_store.h"
+#include "../include/miniz/miniz.h"
+
+class PezArchive {
+public:
+    /* 打开内存中的 PEZ
+     * owned 为 true 时 data 必须由 malloc 分配，之后归 PezArchive 所有，析构时释放（打开失败也一样）；
+     * 否则调用者要保证 data 在 PezArchive 销毁前有效。
+     */
+    PezArchive(const unsigned char* data, size_t size, bool owned);
+    ~PezArchive();
+    PezArchive(const PezArchive&) = delete;
+    PezArchive& operator=(const PezArchive&) = delete;
+
+    bool is_open() const { return open_; }
+    size_t size() const { return size_; }
+    mz_zip_archive* zip() { return &zip_; }
+
+    // 谱面所在的条目：有说明文件的 Chart 字段时只认该文件，否则为第一个以 .json 结尾的文件
+    bool find_chart(mz_uint* index, mz_zip_archive_file_stat* stat);
+
+private:
+    const unsigned char* data_;
+    size_t size_;
+    bool owned_;
+    bool open_;
+    mz_zip_archive zip_;
+};
+
+// 写出新的 ZIP，条目可以从已打开的 PEZ 原样复制，也可以新压缩
+class ZipPassthrough {
+public:
+    // 结果写入 out（先清空），reserve 为预计的大小
+    ZipPassthrough(OutputBuffer& out, size_t reserve);
+    ~ZipPassthrough();
+    ZipPassthrough(const ZipPassthrough&) = delete;
+    ZipPassthrough& operator=(const ZipPassthrough&) = delete;
+
+    // 复制 src 的第 index 个条目，压缩数据与 CRC 保持不变
+    bool copy_entry(PezArchive& src, mz_uint index);
+    // 以默认级别压缩写入新条目
+    bool add(const char* name, const char* data, size_t len);
+    // 写出中央目录；之前任何一步失败都返回 false
+    bool finish();
+
+private:
+    OutputBuffer& out_;
+    mz_zip_archive zip_;
+    bool ok_;
+};
+
+// 与 parse_pez_chart 相同，但直接使用已打开的 PEZ（pez.cpp）
+std::shared_ptr<ParsedChart> parse_pez_chart(PezArchive& pez, ParseResult& stats);
+
+// 与 write_merged_pez 相同，但以已打开的 PEZ 为底包（pez.cpp）
+int write_merged_pez(PezArchive& base, const char* chart_json, size_t chart_len, OutputBuffer& out);